@@ -0,0 +1,469 @@
+/**
+ * Load test of the btferret LE server write path without bluetooth hardware. btlib talks to a fake controller and
+ * central over a Unix socketpair (see hci_transport in btlib.c). The central connects, discovers the characteristic
+ * the phone writes to and sends numbered writes. Reports callback latency (central write to le_server callback)
+ * for acknowledged writes sent one at a time, then sustained throughput of back to back write commands.
+ *
+ * Usage: ble_bench [--messages N] [--size BYTES] [--verbose]
+ * */
+#include "utils.h"
+
+extern "C"
+{
+#include "bluetooth/btferret/btlib.h"
+}
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define BENCH_CONNECTION_HANDLE 0x0040
+#define BENCH_CHARACTERISTIC_UUID 0xDCBA // "Large" characteristic of devices.txt, written by the phone
+#define BENCH_MAX_VALUE_SIZE 244
+#define BENCH_LE_BUFFER_SIZE 251
+#define BENCH_RESPONSE_TIMEOUT 2000 // milliseconds
+// Write commands in flight. btlib keeps received packets in a fixed size stack until le_server calls back,
+// and drops them when a central floods it, so writes are paced like by the buffers of a real controller.
+#define BENCH_WRITE_WINDOW 8
+
+#define H4_COMMAND 0x01
+#define H4_ACL 0x02
+#define H4_EVENT 0x04
+
+#define ATT_ERROR_RESPONSE 0x01
+#define ATT_EXCHANGE_MTU_REQUEST 0x02
+#define ATT_EXCHANGE_MTU_RESPONSE 0x03
+#define ATT_READ_BY_TYPE_REQUEST 0x08
+#define ATT_READ_BY_TYPE_RESPONSE 0x09
+#define ATT_WRITE_REQUEST 0x12
+#define ATT_WRITE_RESPONSE 0x13
+#define ATT_WRITE_COMMAND 0x52
+
+using steady_clock = std::chrono::steady_clock;
+
+struct Options {
+  uint32_t messages = 20000;
+  uint16_t size = 227; // Tile data chunk message
+  bool verbose = false;
+};
+
+// Central side, shared between the script and the thread reading packets sent by btlib
+struct Central {
+  int fd = -1;
+  std::mutex writeMutex;
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  bool advertising = false;
+  bool connected = false;
+  bool mtuExchanged = false;
+  bool discoveryFinished = false;
+  uint16_t nextDiscoveryHandle = 1;
+  uint16_t valueHandle = 0;
+  uint32_t writeResponses = 0;
+  uint32_t errorResponses = 0;
+};
+
+// Server side, filled from the le_server callback
+static std::atomic<bool> serverListening(false);
+static std::atomic<bool> stopServer(false);
+static std::atomic<uint32_t> receivedWrites(0);
+static steady_clock::time_point lastWriteTime;
+static std::vector<steady_clock::time_point> sendTimes;
+// Stays empty for writes whose value was replaced by a later one before the callback read the characteristic
+static std::vector<steady_clock::time_point> callbackTimes;
+
+static double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  std::sort(values.begin(), values.end());
+  auto index = size_t(std::lround(fraction * double(values.size() - 1)));
+  return values[index];
+}
+
+static void sendPacket(Central &central, const std::vector<uint8_t> &packet) {
+  std::lock_guard<std::mutex> lock(central.writeMutex);
+  // btlib may already have closed its end at the end of the run
+  send(central.fd, packet.data(), packet.size(), MSG_NOSIGNAL);
+}
+
+static void sendEvent(Central &central, uint8_t code, const std::vector<uint8_t> &parameters) {
+  std::vector<uint8_t> packet = {H4_EVENT, code, uint8_t(parameters.size())};
+  packet.insert(packet.end(), parameters.begin(), parameters.end());
+  sendPacket(central, packet);
+}
+
+static void sendDisconnection(Central &central) {
+  {
+    std::lock_guard<std::mutex> lock(central.mutex);
+    if (!central.connected) {
+      return;
+    }
+    central.connected = false;
+  }
+  sendEvent(central, 0x05, {0x00, BENCH_CONNECTION_HANDLE & 0xFF, BENCH_CONNECTION_HANDLE >> 8, 0x13});
+}
+
+static void sendAttribute(Central &central, const std::vector<uint8_t> &attribute) {
+  const auto l2capLength = uint16_t(attribute.size());
+  const auto aclLength = uint16_t(l2capLength + 4);
+  std::vector<uint8_t> packet = {
+      H4_ACL, BENCH_CONNECTION_HANDLE & 0xFF, 0x20 | (BENCH_CONNECTION_HANDLE >> 8), // first automatically flushable
+      uint8_t(aclLength & 0xFF), uint8_t(aclLength >> 8),
+      uint8_t(l2capLength & 0xFF), uint8_t(l2capLength >> 8), 0x04, 0x00, // ATT channel
+  };
+  packet.insert(packet.end(), attribute.begin(), attribute.end());
+  sendPacket(central, packet);
+}
+
+// Controller part, every command completes successfully with minimal return parameters
+static void completeCommand(Central &central, const uint8_t *packet) {
+  const uint16_t opcode = packet[1] | (packet[2] << 8);
+  std::vector<uint8_t> parameters = {1, packet[1], packet[2], 0x00};
+
+  switch (opcode) {
+    case 0x1002: // Read Local Supported Commands, including all LE ones
+      parameters.insert(parameters.end(), 64, 0xFF);
+      break;
+    case 0x1009: // Read BD_ADDR
+      parameters.insert(parameters.end(), {0xEE, 0xCC, 0x57, 0xEB, 0x27, 0xB8});
+      break;
+    case 0x2002: // LE Read Buffer Size
+      parameters.insert(parameters.end(), {BENCH_LE_BUFFER_SIZE & 0xFF, BENCH_LE_BUFFER_SIZE >> 8, 8});
+      break;
+    case 0x0406: // Disconnect, completes with a status event and the disconnection itself
+      sendEvent(central, 0x0F, {0x00, 1, packet[1], packet[2]});
+      sendDisconnection(central);
+      return;
+    case 0x200A: { // LE Set Advertising Enable
+      std::lock_guard<std::mutex> lock(central.mutex);
+      central.advertising = packet[4] != 0;
+      central.changed.notify_all();
+    }
+      break;
+    default:
+      parameters.insert(parameters.end(), 8, 0x00);
+      break;
+  }
+  sendEvent(central, 0x0E, parameters);
+}
+
+static void handleAttribute(Central &central, const uint8_t *attribute, size_t length) {
+  std::lock_guard<std::mutex> lock(central.mutex);
+  switch (attribute[0]) {
+    case ATT_EXCHANGE_MTU_REQUEST:
+      sendAttribute(central, {ATT_EXCHANGE_MTU_RESPONSE, (BENCH_MAX_VALUE_SIZE + 3) & 0xFF, 0});
+      central.mtuExchanged = true;
+      break;
+    case ATT_READ_BY_TYPE_RESPONSE: {
+      // Characteristic declarations: handle, properties, value handle, UUID
+      const uint8_t recordLength = attribute[1];
+      for (size_t offset = 2; recordLength >= 7 && offset + recordLength <= length; offset += recordLength) {
+        const uint8_t *record = attribute + offset;
+        const uint16_t handle = record[0] | (record[1] << 8);
+        if (recordLength == 7 && (record[5] | (record[6] << 8)) == BENCH_CHARACTERISTIC_UUID) {
+          central.valueHandle = record[3] | (record[4] << 8);
+        }
+        central.nextDiscoveryHandle = uint16_t(handle + 1);
+      }
+      if (central.valueHandle != 0) {
+        central.discoveryFinished = true;
+      }
+    }
+      break;
+    case ATT_ERROR_RESPONSE:
+      if (attribute[1] == ATT_READ_BY_TYPE_REQUEST) {
+        central.discoveryFinished = true;
+      } else {
+        central.errorResponses++;
+      }
+      break;
+    case ATT_WRITE_RESPONSE:
+      central.writeResponses++;
+      break;
+    default:
+      break;
+  }
+  central.changed.notify_all();
+}
+
+static void readPackets(Central &central) {
+  uint8_t packet[2048];
+  while (true) {
+    const ssize_t length = read(central.fd, packet, sizeof(packet));
+    if (length <= 0) {
+      return; // btlib closed the transport
+    }
+
+    if (packet[0] == H4_COMMAND) {
+      completeCommand(central, packet);
+    } else if (packet[0] == H4_ACL && length >= 10) {
+      // Number Of Completed Packets, as a controller reports after sending data
+      sendEvent(central, 0x13, {1, packet[1], uint8_t(packet[2] & 0x0F), 1, 0});
+      if (packet[7] == 0x04 && packet[8] == 0x00) {
+        handleAttribute(central, packet + 9, size_t(length - 9));
+      }
+    }
+  }
+}
+
+template<typename Predicate>
+static bool waitFor(Central &central, Predicate predicate) {
+  std::unique_lock<std::mutex> lock(central.mutex);
+  return central.changed.wait_for(lock, std::chrono::milliseconds(BENCH_RESPONSE_TIMEOUT), predicate);
+}
+
+// Waits until the server callback ran given number of times, as long as it makes progress
+static bool waitForWrites(uint32_t count) {
+  uint32_t received = receivedWrites.load();
+  auto deadline = steady_clock::now() + std::chrono::milliseconds(BENCH_RESPONSE_TIMEOUT);
+  while (received < count) {
+    if (steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::yield();
+    if (receivedWrites.load() != received) {
+      received = receivedWrites.load();
+      deadline = steady_clock::now() + std::chrono::milliseconds(BENCH_RESPONSE_TIMEOUT);
+    }
+  }
+  return true;
+}
+
+static std::vector<uint8_t> createWrite(uint8_t opcode, uint16_t valueHandle, uint32_t index, uint16_t size) {
+  std::vector<uint8_t> attribute(3 + size, 0);
+  attribute[0] = opcode;
+  attribute[1] = uint8_t(valueHandle & 0xFF);
+  attribute[2] = uint8_t(valueHandle >> 8);
+  attribute[3] = 6; // SEND_MAP_TILE_DATA_CHUNK
+  memcpy(&attribute[4], &index, sizeof(index)); // Message index, read back by the callback
+  for (uint16_t i = 5; i < size; i++) {
+    attribute[3 + i] = uint8_t(index + i);
+  }
+  return attribute;
+}
+
+static void printLatencies(const char *name, uint32_t first, uint32_t count) {
+  std::vector<double> latencies;
+  latencies.reserve(count);
+  for (uint32_t i = first; i < first + count; i++) {
+    if (callbackTimes[i] != steady_clock::time_point()) {
+      latencies.push_back(std::chrono::duration<double, std::micro>(callbackTimes[i] - sendTimes[i]).count());
+    }
+  }
+  printf("%-12s callback latency p50 %8.1f us  p99 %8.1f us  max %8.1f us  missed values %zu\n", name,
+         percentile(latencies, 0.5), percentile(latencies, 0.99), percentile(latencies, 1.0),
+         count - latencies.size());
+}
+
+static bool runCentral(Central &central, const Options &options) {
+  // Connect once the server waits for clients, i.e. its first timer callback ran
+  if (!waitFor(central, [&central] { return central.advertising && serverListening.load(); })) {
+    fprintf(stderr, "LE server did not start advertising\n");
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(central.mutex);
+    central.connected = true;
+  }
+  sendEvent(central, 0x3E, {
+      0x01, 0x00, BENCH_CONNECTION_HANDLE & 0xFF, BENCH_CONNECTION_HANDLE >> 8, 0x01, 0x00, // LE Connection Complete
+      0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x18, 0x00, 0x00, 0x00, 0xF4, 0x01, 0x00
+  });
+  // The server starts with the MTU exchange once it accepted the connection
+  if (!waitFor(central, [&central] { return central.mtuExchanged; })) {
+    fprintf(stderr, "LE server did not accept the connection\n");
+    return false;
+  }
+
+  // Discover characteristic declarations until the value handle is found
+  while (true) {
+    uint16_t start;
+    {
+      std::lock_guard<std::mutex> lock(central.mutex);
+      if (central.discoveryFinished) {
+        break;
+      }
+      start = central.nextDiscoveryHandle;
+    }
+    sendAttribute(central, {ATT_READ_BY_TYPE_REQUEST, uint8_t(start & 0xFF), uint8_t(start >> 8), 0xFF, 0xFF,
+                            0x03, 0x28});
+    if (!waitFor(central, [&central, start] {
+      return central.discoveryFinished || central.nextDiscoveryHandle != start;
+    })) {
+      fprintf(stderr, "Characteristic discovery timed out\n");
+      return false;
+    }
+  }
+  if (central.valueHandle == 0) {
+    fprintf(stderr, "Characteristic %04X not found\n", BENCH_CHARACTERISTIC_UUID);
+    return false;
+  }
+
+  // Write requests, each one waits for the response and the callback before the next one is sent
+  const uint32_t requests = std::max(uint32_t(1), options.messages / 10);
+  std::vector<double> roundTrips;
+  roundTrips.reserve(requests);
+  for (uint32_t i = 0; i < requests; i++) {
+    auto attribute = createWrite(ATT_WRITE_REQUEST, central.valueHandle, i, options.size);
+    sendTimes[i] = steady_clock::now();
+    sendAttribute(central, attribute);
+    if (!waitFor(central, [&central, i] { return central.writeResponses > i; })) {
+      fprintf(stderr, "Write response %u timed out\n", i);
+      return false;
+    }
+    roundTrips.push_back(std::chrono::duration<double, std::micro>(steady_clock::now() - sendTimes[i]).count());
+    // The response is sent before the callback runs, so latency is taken from the callback itself
+    if (!waitForWrites(i + 1)) {
+      fprintf(stderr, "Server callback missed write request %u\n", i);
+      return false;
+    }
+  }
+  printLatencies("requests", 0, requests);
+  printf("%-12s round trip       p50 %8.1f us  p99 %8.1f us\n", "",
+         percentile(roundTrips, 0.5), percentile(roundTrips, 0.99));
+
+  // Write commands sent back to back within the window
+  const auto start = steady_clock::now();
+  for (uint32_t i = requests; i < requests + options.messages; i++) {
+    auto attribute = createWrite(ATT_WRITE_COMMAND, central.valueHandle, i, options.size);
+    if (i >= BENCH_WRITE_WINDOW && !waitForWrites(i - BENCH_WRITE_WINDOW)) {
+      fprintf(stderr, "Server callback stalled at write command %u\n", receivedWrites.load() - requests);
+      return false;
+    }
+    sendTimes[i] = steady_clock::now();
+    sendAttribute(central, attribute);
+  }
+  if (!waitForWrites(requests + options.messages)) {
+    fprintf(stderr, "Server callback received %u of %u write commands\n",
+            receivedWrites.load() - requests, options.messages);
+    return false;
+  }
+  const double seconds = std::chrono::duration<double>(lastWriteTime - start).count();
+  printLatencies("commands", requests, options.messages);
+  printf("%-12s throughput %8.0f messages/s  %8.1f KB/s of values\n", "",
+         options.messages / seconds, options.messages * options.size / seconds / 1024.0);
+  if (central.errorResponses > 0) {
+    printf("ATT error responses: %u\n", central.errorResponses);
+  }
+
+  return true;
+}
+
+static void recordWrite(unsigned char *data, int count) {
+  (void) count;
+  const auto now = steady_clock::now();
+  uint32_t index;
+  memcpy(&index, data + 1, sizeof(index));
+  if (index < callbackTimes.size()) {
+    callbackTimes[index] = now;
+  }
+  lastWriteTime = now;
+  receivedWrites++;
+}
+
+// Same as le_value_callback in bluetoothServer.cpp
+static int valueCallback(int clientnode, int cticn, unsigned char *data, int count,
+                         void (*onMessage)(unsigned char *data, int count)) {
+  (void) clientnode;
+  (void) cticn;
+  onMessage(data, count);
+  return SERVER_CONTINUE;
+}
+
+static int serverCallback(int clientnode, int operation, int cticn, void (*onMessage)(unsigned char *data, int count)) {
+  (void) clientnode;
+  (void) cticn;
+  (void) onMessage;
+
+  if (operation == LE_TIMER) {
+    serverListening = true;
+    if (stopServer) {
+      return SERVER_EXIT;
+    }
+  } else if (operation == LE_DISCONNECT) {
+    return SERVER_EXIT;
+  }
+  return SERVER_CONTINUE;
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options) {
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (argument == "--messages" && hasValue) {
+      options.messages = uint32_t(std::max(1, atoi(argv[++i])));
+    } else if (argument == "--size" && hasValue) {
+      options.size = uint16_t(std::min(std::max(5, atoi(argv[++i])), BENCH_MAX_VALUE_SIZE));
+    } else if (argument == "--verbose") {
+      options.verbose = true;
+    } else {
+      fprintf(stderr, "Usage: %s [--messages N] [--size BYTES] [--verbose]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+  registerExecutablePath(argv[0]);
+  // le_server switches the terminal to raw mode and polls it for the stop key, which is not used here
+  if (freopen("/dev/null", "r", stdin) == nullptr) {
+    perror("freopen");
+  }
+
+  int sockets[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets) != 0) {
+    perror("socketpair");
+    return 1;
+  }
+  hci_transport(sockets[0]);
+
+  const uint32_t totalMessages = std::max(uint32_t(1), options.messages / 10) + options.messages;
+  sendTimes.resize(totalMessages);
+  callbackTimes.resize(totalMessages);
+
+  Central central;
+  central.fd = sockets[1];
+  std::thread reader(readPackets, std::ref(central));
+
+  const auto devicesPath = pwd() + "/../devices.txt";
+  if (init_blue(devicesPath.c_str()) == 0) {
+    fprintf(stderr, "btlib initialisation failed\n");
+    return 1;
+  }
+  set_print_flag(options.verbose ? PRINT_VERBOSE : PRINT_NONE);
+
+  bool passed = false;
+  std::thread script([&central, &options, &passed] {
+    passed = runCentral(central, options);
+    sendDisconnection(central);
+    // Ends the server loop also if the central failed before connecting
+    stopServer = true;
+  });
+  le_write_callback(valueCallback);
+  le_server(serverCallback, 1, recordWrite);
+  script.join();
+
+  close_all();
+  reader.join();
+  close(sockets[1]);
+  return passed ? 0 : 1;
+}
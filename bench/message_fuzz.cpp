@@ -0,0 +1,311 @@
+/**
+ * Fuzz target for the inbound message decoder. Feeds arbitrary characteristic values through handleMessage and
+ * the regular core against mocked LCD and bluetooth server, so decoding errors surface as crashes or sanitizer
+ * reports rather than as corrupted tiles and tours on the device.
+ *
+ * Built with -DMESSAGE_FUZZ_LIBFUZZER=ON (clang) the target is driven by libFuzzer. Otherwise it runs its own
+ * mutation loop over valid messages of every type, which is reproducible by seed.
+ *
+ * Usage: message_fuzz [--iterations N (default 200000)] [--seed N]
+ * */
+#include "bluetooth/messageFormats.h"
+#include "bluetooth/messageHandler.h"
+#include "core/core.h"
+#include "core/tile.h"
+#include "mock/bluetoothServerMock.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#define FUZZ_UPDATE_INTERVAL 64 // Inputs between core updates, which cluster and simplify received tours
+#define FUZZ_RESET_INTERVAL 4096
+
+typedef std::array<uint8_t, MESSAGE_IN_MAX_SIZE> MessageInBuffer;
+
+static uint32_t fuzzedInputs = 0;
+static std::string tilesCacheDirectory;
+
+static bool initialize(const char *executablePath) {
+  // Assets are loaded relative to the executable, as for BikeTourAssistant
+  registerExecutablePath(executablePath);
+  CORE.start();
+
+  char directory[] = "/tmp/message_fuzz_tiles_XXXXXX";
+  if (mkdtemp(directory) == nullptr) {
+    fprintf(stderr, "Cannot create temporary tiles cache directory\n");
+    return false;
+  }
+  tilesCacheDirectory = directory;
+  Tile::setCacheDirectory(tilesCacheDirectory);
+
+  CORE.isBluetoothConnected = true;
+  resetOutMessagesQueue();
+  CORE.reset();
+  return true;
+}
+
+static void fuzzMessage(const uint8_t *data, size_t size) {
+  if (size == 0 || data[0] == MESSAGE_IN_TAKE_PHOTO || data[0] == MESSAGE_IN_SET_DISTANCE_PER_PHOTO) {
+    // Photos would run libcamera-still and write into the photos directory
+    return;
+  }
+  // handleMessage gets at most one characteristic value, copied so that reads past its end are caught
+  std::vector<uint8_t> message(data, data + std::min(size, size_t(MESSAGE_IN_MAX_SIZE)));
+  handleMessage(message.data(), int(message.size()));
+
+  if (++fuzzedInputs % FUZZ_UPDATE_INTERVAL == 0) {
+    CORE.update();
+  }
+  if (fuzzedInputs % FUZZ_RESET_INTERVAL == 0) {
+    // Tour chunks without a start message, tiles of mutated coordinates and unconfirmed outbound messages
+    // pile up, which only slows down later inputs. Same reset as on a new connection.
+    resetLocationKeyframe();
+    resetOutMessagesQueue();
+    CORE.reset();
+  }
+  takeSentBluetoothMessages();
+}
+
+#ifdef MESSAGE_FUZZ_LIBFUZZER
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv) {
+  (void) argc;
+  return initialize((*argv)[0]) ? 0 : 1;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  fuzzMessage(data, size);
+  return 0;
+}
+
+#else
+
+struct Options {
+  uint32_t iterations = 200000;
+  uint32_t seed = 1;
+};
+
+struct SeedMessage {
+  MessageInBuffer data;
+  size_t length;
+};
+
+static SeedMessage createSeed(MessageInType type, size_t length) {
+  SeedMessage seed = {{{0}}, length};
+  seed.data[0] = uint8_t(type);
+  return seed;
+}
+
+static uint32_t zigZagEncode(int32_t value) {
+  return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+static size_t writeVarint(MessageInBuffer &data, size_t offset, uint32_t value) {
+  while (value >= 0x80) {
+    data[offset++] = uint8_t(value | 0x80);
+    value >>= 7;
+  }
+  data[offset++] = uint8_t(value);
+  return offset;
+}
+
+// One valid message of every type but the photo ones, tile and tour streams complete whenever chunks follow their start messages
+static std::vector<SeedMessage> createSeeds() {
+  using namespace message_in;
+  std::vector<SeedMessage> seeds;
+
+  seeds.push_back(createSeed(MESSAGE_IN_PING, 1));
+  seeds.push_back(createSeed(MESSAGE_IN_CONFIRM_RECEIVED_MESSAGE, 1));
+  seeds.push_back(createSeed(MESSAGE_IN_CLEAR_TOUR_DATA, 1));
+
+  auto seed = createSeed(MESSAGE_IN_SET_LIGHTNESS, SetLightness::Lightness::end);
+  MessageWriter<MESSAGE_IN_MAX_SIZE>(seed.data).set<SetLightness::Lightness>(80);
+  seeds.push_back(seed);
+
+  seed = createSeed(MESSAGE_IN_LOCATION_UPDATE, LocationUpdate::MapZoom::end);
+  MessageWriter<MESSAGE_IN_MAX_SIZE> location(seed.data);
+  location.set<LocationUpdate::Latitude>(50.06);
+  location.set<LocationUpdate::Longitude>(19.94);
+  location.set<LocationUpdate::Speed>(5.5);
+  location.set<LocationUpdate::Heading>(90.0);
+  location.set<LocationUpdate::Altitude>(220.0);
+  location.set<LocationUpdate::AltitudeAccuracy>(3.0);
+  location.set<LocationUpdate::Accuracy>(5.0);
+  location.set<LocationUpdate::Timestamp>(1700000000000);
+  location.set<LocationUpdate::MapZoom>(16);
+  seeds.push_back(seed);
+
+  seed = createSeed(MESSAGE_IN_LOCATION_UPDATE_DELTA, LocationUpdateDelta::MapZoom::end);
+  MessageWriter<MESSAGE_IN_MAX_SIZE> locationDelta(seed.data);
+  locationDelta.set<LocationUpdateDelta::LatitudeDelta>(-250);
+  locationDelta.set<LocationUpdateDelta::LongitudeDelta>(410);
+  locationDelta.set<LocationUpdateDelta::Speed>(550);
+  locationDelta.set<LocationUpdateDelta::Heading>(9000);
+  locationDelta.set<LocationUpdateDelta::Altitude>(880);
+  locationDelta.set<LocationUpdateDelta::AltitudeAccuracy>(6);
+  locationDelta.set<LocationUpdateDelta::Accuracy>(10);
+  locationDelta.set<LocationUpdateDelta::TimestampDelta>(1000);
+  locationDelta.set<LocationUpdateDelta::MapZoom>(16);
+  seeds.push_back(seed);
+
+  seed = createSeed(MESSAGE_IN_SEND_MAP_TILE_START, MapTileStart::DataByteLength::end);
+  MessageWriter<MESSAGE_IN_MAX_SIZE> tileStart(seed.data);
+  tileStart.set<MapTileStart::X>(36408);
+  tileStart.set<MapTileStart::Y>(22180);
+  tileStart.set<MapTileStart::Z>(16);
+  tileStart.set<MapTileStart::DataByteLength>(3 * TILE_CHUNK_SIZE + 17);
+  seeds.push_back(seed);
+  // Same tile in the other formats, chunks of zeros are then decoded by their decoders
+  for (uint8_t format = TILE_FORMAT_PNG + 1; format < TILE_FORMATS_COUNT; format++) {
+    MessageWriter<MESSAGE_IN_MAX_SIZE>(seed.data).set<MapTileStart::Format>(format);
+    seed.length = MapTileStart::Format::end;
+    seeds.push_back(seed);
+  }
+
+  for (uint16_t chunkIndex = 0; chunkIndex < 4; chunkIndex++) {
+    seed = createSeed(MESSAGE_IN_SEND_MAP_TILE_DATA_CHUNK, MapTileDataChunk::dataOffset + TILE_CHUNK_SIZE);
+    MessageWriter<MESSAGE_IN_MAX_SIZE>(seed.data).set<MapTileDataChunk::ChunkIndex>(chunkIndex);
+    seeds.push_back(seed);
+  }
+
+  seed = createSeed(MESSAGE_IN_SEND_TOUR_START, Count16::Count::end);
+  MessageWriter<MESSAGE_IN_MAX_SIZE>(seed.data).set<Count16::Count>(2 * TourDataChunk::Points::maxCount);
+  seeds.push_back(seed);
+
+  seed = createSeed(MESSAGE_IN_SEND_TOUR_START_V2, TourStartV2::PointsCount::end);
+  MessageWriter<MESSAGE_IN_MAX_SIZE>(seed.data).set<TourStartV2::PointsCount>(2 * TourDataChunkV2::Points::maxCount);
+  seeds.push_back(seed);
+
+  seed = createSeed(MESSAGE_IN_SEND_POINTS_OF_INTEREST_START, Count16::Count::end);
+  MessageWriter<MESSAGE_IN_MAX_SIZE>(seed.data).set<Count16::Count>(PointsOfInterestDataChunk::Points::maxCount);
+  seeds.push_back(seed);
+
+  seed = createSeed(MESSAGE_IN_SEND_TOUR_DATA_CHUNK, TourDataChunk::Points::offset +
+                                                     TourDataChunk::Points::maxCount * TourDataChunk::Points::stride);
+  MessageWriter<MESSAGE_IN_MAX_SIZE> tourChunk(seed.data);
+  tourChunk.set<TourDataChunk::ChunkSize>(TourDataChunk::Points::maxCount);
+  for (uint32_t i = 0; i < TourDataChunk::Points::maxCount; i++) {
+    tourChunk.set<TourDataChunk::PointIndex>(i, uint16_t(i));
+    tourChunk.set<TourDataChunk::Latitude>(i, 50.06f + 0.0005f * float(i));
+    tourChunk.set<TourDataChunk::Longitude>(i, 19.94f + 0.0005f * float(i));
+  }
+  seeds.push_back(seed);
+
+  seed = createSeed(MESSAGE_IN_SEND_TOUR_DATA_CHUNK_V2,
+                    TourDataChunkV2::Points::offset +
+                    TourDataChunkV2::Points::maxCount * TourDataChunkV2::Points::stride);
+  MessageWriter<MESSAGE_IN_MAX_SIZE> tourChunkV2(seed.data);
+  tourChunkV2.set<TourDataChunkV2::ChunkSize>(TourDataChunkV2::Points::maxCount);
+  for (uint32_t i = 0; i < TourDataChunkV2::Points::maxCount; i++) {
+    tourChunkV2.set<TourDataChunkV2::PointIndex>(i, TourDataChunkV2::Points::maxCount + i);
+    tourChunkV2.set<TourDataChunkV2::Latitude>(i, 50.06f - 0.0005f * float(i));
+    tourChunkV2.set<TourDataChunkV2::Longitude>(i, 19.94f + 0.0005f * float(i));
+  }
+  seeds.push_back(seed);
+
+  // Winding route with a segment break halfway, as many points as fit the message
+  seed = createSeed(MESSAGE_IN_SEND_TOUR_DATA_CHUNK_V3, TourDataChunkV3::deltasOffset);
+  MessageWriter<MESSAGE_IN_MAX_SIZE> tourChunkV3(seed.data);
+  tourChunkV3.set<TourDataChunkV3::FirstPointIndex>(2 * TourDataChunkV2::Points::maxCount);
+  tourChunkV3.set<TourDataChunkV3::Latitude>(5006000);
+  tourChunkV3.set<TourDataChunkV3::Longitude>(1994000);
+  uint16_t compactPointsCount = 1;
+  for (; seed.length + 2 * 5 <= MESSAGE_IN_MAX_SIZE; compactPointsCount++) {
+    const bool segmentBreak = compactPointsCount == 30;
+    seed.length = writeVarint(seed.data, seed.length,
+                              zigZagEncode(compactPointsCount % 8 < 4 ? 37 : -21) << 1 | (segmentBreak ? 1 : 0));
+    seed.length = writeVarint(seed.data, seed.length, zigZagEncode(segmentBreak ? 900 : 52));
+  }
+  tourChunkV3.set<TourDataChunkV3::ChunkSize>(compactPointsCount);
+  seeds.push_back(seed);
+
+  seed = createSeed(MESSAGE_IN_SEND_POINTS_OF_INTEREST_DATA_CHUNK,
+                    PointsOfInterestDataChunk::Points::offset +
+                    PointsOfInterestDataChunk::Points::maxCount * PointsOfInterestDataChunk::Points::stride);
+  MessageWriter<MESSAGE_IN_MAX_SIZE> pointsOfInterestChunk(seed.data);
+  pointsOfInterestChunk.set<PointsOfInterestDataChunk::ChunkSize>(PointsOfInterestDataChunk::Points::maxCount);
+  for (uint32_t i = 0; i < PointsOfInterestDataChunk::Points::maxCount; i++) {
+    pointsOfInterestChunk.set<PointsOfInterestDataChunk::Latitude>(i, 50.05f + 0.001f * float(i));
+    pointsOfInterestChunk.set<PointsOfInterestDataChunk::Longitude>(i, 19.93f);
+  }
+  seeds.push_back(seed);
+
+  return seeds;
+}
+
+// Overwrites a few bytes, sets a boundary value or truncates the message
+static size_t mutate(MessageInBuffer &data, size_t length, std::mt19937 &random) {
+  const uint32_t mutations = random() % 4;
+  for (uint32_t i = 0; i < mutations; i++) {
+    const size_t position = 1 + random() % (data.size() - 1); // Type byte is kept, unknown types are cheap
+    switch (random() % 4) {
+      case 0:
+        data[position] = uint8_t(random());
+        break;
+      case 1:
+        data[position] = random() % 2 ? 0x00 : 0xFF;
+        break;
+      case 2:
+        data[position] ^= uint8_t(1 << (random() % 8));
+        break;
+      default:
+        length = 1 + random() % data.size();
+        break;
+    }
+  }
+  return length;
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options) {
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (argument == "--iterations" && hasValue) {
+      options.iterations = uint32_t(std::max(1, atoi(argv[++i])));
+    } else if (argument == "--seed" && hasValue) {
+      options.seed = uint32_t(strtoul(argv[++i], nullptr, 10));
+    } else {
+      fprintf(stderr, "Usage: %s [--iterations N] [--seed N]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+  if (!initialize(argv[0])) {
+    return 1;
+  }
+
+  const auto seeds = createSeeds();
+  std::mt19937 random(options.seed);
+  const auto startTime = std::chrono::steady_clock::now();
+
+  for (uint32_t i = 0; i < options.iterations; i++) {
+    const auto &seed = seeds[random() % seeds.size()];
+    MessageInBuffer data = seed.data;
+    const size_t length = mutate(data, seed.length, random);
+    fuzzMessage(data.data(), length);
+  }
+
+  const double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  printf("Fuzzed %u messages (seed %u) in %.2f s, %.0f messages/s\n", fuzzedInputs, options.seed, duration,
+         duration > 0 ? double(fuzzedInputs) / duration : 0.0);
+
+  free(executeCommand(("rm -rf " + tilesCacheDirectory).c_str()));
+  return 0;
+}
+
+#endif // MESSAGE_FUZZ_LIBFUZZER
@@ -0,0 +1,166 @@
+/**
+ * Hardware interface of DEV_Config.h without hardware. GPIO writes are ignored except for the data/command pin,
+ * and bytes written over SPI drive a minimal emulation of the LCD controller (column and row address set,
+ * memory write), so whatever the renderer sends ends up in a readable panel memory.
+ * */
+#include "DEV_Config.h"
+#include "DEV_Mock.h"
+#include "LCD_2inch4.h"
+
+#define COMMAND_COLUMN_ADDRESS_SET 0x2A
+#define COMMAND_ROW_ADDRESS_SET 0x2B
+#define COMMAND_MEMORY_WRITE 0x2C
+
+static uint16_t panel[LCD_2IN4_WIDTH * LCD_2IN4_HEIGHT];
+static uint64_t transferredBytes = 0;
+
+static UBYTE dataPin = 0;
+static UBYTE command = 0;
+static UBYTE parameters[4];
+static uint8_t parameterCount = 0;
+
+// Address window and position of the next pixel in it
+static UWORD columnStart = 0, columnEnd = LCD_2IN4_WIDTH - 1;
+static UWORD rowStart = 0, rowEnd = LCD_2IN4_HEIGHT - 1;
+static UWORD column = 0, row = 0;
+static int pendingHighByte = -1;
+
+static void advancePixel(void)
+{
+  if (++column > columnEnd) {
+    column = columnStart;
+    if (++row > rowEnd) {
+      row = rowStart;
+    }
+  }
+}
+
+static void writePixel(uint16_t color)
+{
+  if (column < LCD_2IN4_WIDTH && row < LCD_2IN4_HEIGHT) {
+    panel[row * LCD_2IN4_WIDTH + column] = color;
+  }
+  advancePixel();
+}
+
+static void receiveByte(UBYTE value)
+{
+  if (!dataPin) {
+    command = value;
+    parameterCount = 0;
+    pendingHighByte = -1;
+    if (command == COMMAND_MEMORY_WRITE) {
+      column = columnStart;
+      row = rowStart;
+    }
+    return;
+  }
+
+  switch (command) {
+    case COMMAND_COLUMN_ADDRESS_SET:
+    case COMMAND_ROW_ADDRESS_SET:
+      if (parameterCount < 4) {
+        parameters[parameterCount++] = value;
+      }
+      if (parameterCount == 4) {
+        UWORD start = (UWORD) (parameters[0] << 8 | parameters[1]);
+        UWORD end = (UWORD) (parameters[2] << 8 | parameters[3]);
+        if (command == COMMAND_COLUMN_ADDRESS_SET) {
+          columnStart = start, columnEnd = end;
+        } else {
+          rowStart = start, rowEnd = end;
+        }
+      }
+      break;
+    case COMMAND_MEMORY_WRITE:
+      if (pendingHighByte < 0) {
+        pendingHighByte = value;
+      } else {
+        writePixel((uint16_t) (pendingHighByte << 8 | value));
+        pendingHighByte = -1;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+const uint16_t *DEV_Mock_GetPanel(void)
+{
+  return panel;
+}
+
+uint64_t DEV_Mock_GetTransferredBytes(void)
+{
+  return transferredBytes;
+}
+
+void DEV_SetBacklight(UWORD Value)
+{
+  (void) Value;
+}
+
+void DEV_Digital_Write(UWORD Pin, UBYTE Value)
+{
+  if (Pin == LCD_DC) {
+    dataPin = Value;
+  }
+}
+
+UBYTE DEV_Digital_Read(UWORD Pin)
+{
+  (void) Pin;
+  return 0;
+}
+
+void DEV_GPIO_Mode(UWORD Pin, UWORD Mode)
+{
+  (void) Pin;
+  (void) Mode;
+}
+
+void DEV_Delay_ms(UDOUBLE xms)
+{
+  (void) xms;
+}
+
+UBYTE DEV_ModuleInit(void)
+{
+  return 0;
+}
+
+void DEV_SPI_WriteByte(UBYTE Value)
+{
+  transferredBytes++;
+  receiveByte(Value);
+}
+
+void DEV_SPI_Write_nByte(uint8_t *pData, uint32_t Len)
+{
+  transferredBytes += Len;
+  uint32_t i = 0;
+
+  // Pixel data is stored a window row at a time, so the sink does not dominate measured frame times
+  if (dataPin && command == COMMAND_MEMORY_WRITE && pendingHighByte < 0) {
+    while (Len - i >= 2 && row < LCD_2IN4_HEIGHT && columnEnd < LCD_2IN4_WIDTH) {
+      uint32_t count = (uint32_t) (columnEnd - column + 1);
+      if (count > (Len - i) / 2) {
+        count = (Len - i) / 2;
+      }
+      uint16_t *target = &panel[row * LCD_2IN4_WIDTH + column];
+      for (uint32_t j = 0; j < count; j++, i += 2) {
+        target[j] = (uint16_t) (pData[i] << 8 | pData[i + 1]);
+      }
+      column = (UWORD) (column + count - 1);
+      advancePixel();
+    }
+  }
+
+  for (; i < Len; i++) {
+    receiveByte(pData[i]);
+  }
+}
+
+void DEV_ModuleExit(void)
+{
+}
@@ -0,0 +1,23 @@
+#ifndef BENCH_DEV_MOCK_H
+#define BENCH_DEV_MOCK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Panel memory of the emulated LCD controller, LCD_2IN4_WIDTH x LCD_2IN4_HEIGHT RGB565 pixels in the order
+ * they are addressed by the column and row commands. Filled by pixel data written over the mocked SPI.
+ * */
+const uint16_t *DEV_Mock_GetPanel(void);
+
+// Bytes written over SPI since start, commands included
+uint64_t DEV_Mock_GetTransferredBytes(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BENCH_DEV_MOCK_H
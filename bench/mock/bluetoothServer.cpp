@@ -0,0 +1,22 @@
+#include "bluetooth/bluetoothServer.h"
+#include "bluetooth/messageHandler.h"
+#include "bluetoothServerMock.h"
+
+#include <cstdio>
+
+static std::vector<std::vector<uint8_t>> sentMessages;
+
+void startBluetoothServer(void (*onMessage)(unsigned char *data, int count)) {
+  (void) onMessage;
+  fprintf(stderr, "Bluetooth server is not available in the mocked build\n");
+}
+
+void sendBluetoothMessage(unsigned char *data) {
+  sentMessages.emplace_back(data, data + MESSAGE_OUT_SIZE);
+}
+
+std::vector<std::vector<uint8_t>> takeSentBluetoothMessages() {
+  std::vector<std::vector<uint8_t>> messages;
+  messages.swap(sentMessages);
+  return messages;
+}
@@ -0,0 +1,13 @@
+#ifndef BENCH_BLUETOOTH_SERVER_MOCK_H
+#define BENCH_BLUETOOTH_SERVER_MOCK_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Stands in for src/bluetooth/bluetoothServer.cpp without BlueZ. Messages passed to sendBluetoothMessage are
+ * kept in memory instead of being written to the characteristic.
+ * */
+std::vector<std::vector<uint8_t>> takeSentBluetoothMessages();
+
+#endif // BENCH_BLUETOOTH_SERVER_MOCK_H
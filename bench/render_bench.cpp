@@ -0,0 +1,499 @@
+/**
+ * Headless map rendering benchmark. Renders synthetic scenarios (zoom levels, headings, movement and route
+ * densities) through the regular renderer into a mocked LCD, reports p50/p99 frame times for every map
+ * sampling mode, along with p50 of the map layer and route stages, and compares a frame of each run with golden
+ * PNGs. The route stage of every scenario is also timed on its own, with PolylineRasterizer as the renderer
+ * draws it and with the previous Paint_DrawLine loop. --workers and --bands take comma separated
+ * lists of map render worker and band counts, every combination is run.
+ *
+ * Usage: render_bench [--frames N] [--scenario NAME] [--golden DIR] [--update-golden] [--tolerance N]
+ *                     [--workers N,...] [--bands N,...]
+ * */
+#include "core/renderer.h"
+#include "core/tile.h"
+#include "core/tour.h"
+#include "display/polyline.h"
+#include "lodepng/lodepng.h"
+#include "mock/DEV_Mock.h"
+#include "syntheticTile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include "GUI_Paint.h"
+}
+
+#define BENCH_TILE_SIZE 256
+#define BENCH_TILES_RADIUS 3
+#define BENCH_WARMUP_FRAMES 5
+// Frame compared with golden images, it does not depend on the number of measured frames
+#define BENCH_GOLDEN_STEP 60
+#define BENCH_ROUTE_COLOR 0xFD24 // RGB565 of the route color of renderMap
+#define BENCH_ROUTE_TILE_RADIUS 3 // As passed to getNearbyPoints by renderMap
+
+struct Scenario {
+  const char *name;
+  uint8_t zoom;
+  double heading; // degrees
+  double headingStep; // degrees per frame
+  double stepX; // map pixels per frame, towards east
+  double stepY; // map pixels per frame, towards south
+  uint32_t routePointsCount;
+  double routePointSpacing; // map pixels
+  double routeZigZag; // map pixels, route zig-zags this far to either side of a straight axis instead of meandering
+};
+
+static const Scenario scenarios[] = {
+    {"z15_static", 15, 30.0, 0.0, 0.0, 0.0, 200, 20.0, 0.0},
+    {"z15_rotating", 15, 0.0, 3.0, 0.0, 0.0, 500, 12.0, 0.0},
+    {"z16_translating", 16, 45.0, 0.0, 1.5, -0.8, 2000, 4.0, 0.0},
+    // Heading creeping around 45 degrees, every frame is resampled diagonally across tile rows
+    {"z16_diagonal", 16, 44.5, 0.005, 0.0, 0.0, 300, 8.0, 0.0},
+    // Route much longer than the view, simplified to few vertices around it
+    {"z17_dense_route", 17, 120.0, 1.0, 0.6, 0.9, 10000, 1.5, 0.0},
+    // Segments of about 1400 px between vertices far off both sides of the view, none is simplified away and
+    // every drawn one is clipped to the view
+    {"z17_zigzag_route", 17, 75.0, 0.7, 0.3, -0.2, 400, 6.0, 700.0},
+    {"z13_sparse_route", 13, 200.0, 5.0, -0.5, 0.0, 50, 60.0, 0.0},
+};
+
+static const struct {
+  MapSamplingMode mode;
+  const char *name;
+} samplingModes[] = {
+    {SAMPLING_NEAREST, "nearest"},
+    {SAMPLING_BILINEAR, "bilinear"},
+};
+
+struct Options {
+  uint32_t frames = 200;
+  std::string scenario;
+  std::string goldenDirectory;
+  bool updateGolden = false;
+  int tolerance = 0; // Largest accepted difference of a color channel (0-255)
+  // Map render threads, renderer defaults when both are empty
+  std::vector<uint32_t> workerCounts;
+  std::vector<uint32_t> bandCounts;
+};
+
+// Route segment relative to the map center, rotated by heading, as renderMap passes it to centerAndTrimLineSegment
+struct RouteSegment {
+  double startX;
+  double startY;
+  double endX;
+  double endY;
+};
+
+// Map pixel coordinates at given zoom (BENCH_TILE_SIZE pixels per tile) to latitude and longitude
+static void pixelToLatLong(double x, double y, uint8_t zoom, double &latitude, double &longitude) {
+  const double size = double(uint64_t(1) << zoom) * BENCH_TILE_SIZE;
+  longitude = x / size * 360.0 - 180.0;
+  latitude = std::atan(std::sinh(M_PI * (1.0 - 2.0 * y / size))) * 180.0 / M_PI;
+}
+
+static Tile *createSyntheticTile(uint32_t tileX, uint32_t tileY, uint8_t zoom) {
+  std::vector<uint8_t> indices;
+  Rgb565Palette palette;
+  indexRgbImage(createSyntheticTileImage(tileX, tileY, BENCH_TILE_SIZE), indices, palette);
+  return new Tile(tileX, tileY, zoom, BENCH_TILE_SIZE, BENCH_TILE_SIZE, indices, palette);
+}
+
+// Meandering or zig-zag route centered on the start location, plus a few points of interest along it
+static void createRoute(const Scenario &scenario, double startX, double startY, Tour &tour) {
+  tour.clear(scenario.routePointsCount);
+  tour.setZoom(scenario.zoom);
+
+  std::vector<std::pair<double, double>> points(scenario.routePointsCount);
+  double x = 0, y = 0;
+  for (uint32_t i = 0; i < scenario.routePointsCount; i++) {
+    if (scenario.routeZigZag > 0.0) {
+      // Vertices alternate sides of an axis passing through the start location
+      const double axisAngle = 0.3;
+      const double along = (double(i) - double(scenario.routePointsCount / 2)) * scenario.routePointSpacing;
+      const double across = i % 2 == 0 ? -scenario.routeZigZag : scenario.routeZigZag;
+      points[i] = std::make_pair(along * std::cos(axisAngle) - across * std::sin(axisAngle),
+                                 along * std::sin(axisAngle) + across * std::cos(axisAngle));
+      continue;
+    }
+    const double direction = 0.7 * std::sin(i * 0.013) + 0.5 * std::sin(i * 0.071) + i * 0.002;
+    x += scenario.routePointSpacing * std::cos(direction);
+    y += scenario.routePointSpacing * std::sin(direction);
+    points[i] = std::make_pair(x, y);
+  }
+
+  const auto &middle = points[scenario.routePointsCount / 2];
+  const double offsetX = startX - (scenario.routeZigZag > 0.0 ? 0.0 : middle.first);
+  const double offsetY = startY - (scenario.routeZigZag > 0.0 ? 0.0 : middle.second);
+  for (uint32_t i = 0; i < scenario.routePointsCount; i++) {
+    double latitude, longitude;
+    pixelToLatLong(points[i].first + offsetX, points[i].second + offsetY, scenario.zoom, latitude, longitude);
+    tour.pushPoint(i, latitude, longitude);
+  }
+
+  const uint16_t pointsOfInterestCount = 3;
+  tour.resetPointsOfInterest(pointsOfInterestCount);
+  for (uint16_t i = 0; i < pointsOfInterestCount; i++) {
+    const auto &point = points[scenario.routePointsCount / 2 + (i + 1) * 7 % (scenario.routePointsCount / 2)];
+    double latitude, longitude;
+    pixelToLatLong(point.first + offsetX, point.second + offsetY, scenario.zoom, latitude, longitude);
+    tour.pushPointOfInterest(latitude, longitude);
+  }
+}
+
+// Map area of the mocked panel as RGB, in map coordinates (the panel holds it rotated by 180 degrees)
+static std::vector<uint8_t> captureMap() {
+  const uint16_t *panel = DEV_Mock_GetPanel();
+  std::vector<uint8_t> image(MAP_WIDTH * MAP_HEIGHT * 3);
+
+  for (uint16_t y = 0; y < MAP_HEIGHT; y++) {
+    for (uint16_t x = 0; x < MAP_WIDTH; x++) {
+      const uint16_t color = panel[(MAP_HEIGHT - 1 - y) * LCD_2IN4_WIDTH + (MAP_WIDTH - 1 - x)];
+      const uint8_t red = (color >> 11) & 0x1F;
+      const uint8_t green = (color >> 5) & 0x3F;
+      const uint8_t blue = color & 0x1F;
+      uint8_t *pixel = &image[(size_t(y) * MAP_WIDTH + x) * 3];
+      pixel[0] = uint8_t(red << 3 | red >> 2);
+      pixel[1] = uint8_t(green << 2 | green >> 4);
+      pixel[2] = uint8_t(blue << 3 | blue >> 2);
+    }
+  }
+  return image;
+}
+
+/**
+ * Compares the image with the golden PNG, or replaces the golden PNG when updating.
+ * Returns false on mismatch or missing golden image.
+ * */
+static bool checkGoldenImage(const std::vector<uint8_t> &image, const std::string &path, const Options &options,
+                             std::string &status) {
+  if (options.updateGolden) {
+    unsigned error = lodepng::encode(path, image, MAP_WIDTH, MAP_HEIGHT, LCT_RGB);
+    status = error ? std::string("write failed: ") + lodepng_error_text(error) : "updated";
+    return error == 0;
+  }
+
+  std::vector<uint8_t> golden;
+  unsigned width, height;
+  unsigned error = lodepng::decode(golden, width, height, path, LCT_RGB);
+  if (error) {
+    status = std::string("missing golden: ") + lodepng_error_text(error);
+    return false;
+  }
+  if (width != MAP_WIDTH || height != MAP_HEIGHT) {
+    status = "golden size differs";
+    return false;
+  }
+
+  uint32_t differentPixels = 0;
+  int maxDifference = 0;
+  for (size_t i = 0; i < image.size(); i += 3) {
+    int pixelDifference = 0;
+    for (uint8_t channel = 0; channel < 3; channel++) {
+      pixelDifference = std::max(pixelDifference, std::abs(int(image[i + channel]) - int(golden[i + channel])));
+    }
+    if (pixelDifference > options.tolerance) {
+      differentPixels++;
+    }
+    maxDifference = std::max(maxDifference, pixelDifference);
+  }
+
+  if (differentPixels > 0) {
+    status = "MISMATCH " + std::to_string(differentPixels) + " px, max difference " + std::to_string(maxDifference);
+    return false;
+  }
+  status = "ok";
+  return true;
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+  std::sort(values.begin(), values.end());
+  auto index = size_t(std::lround(fraction * double(values.size() - 1)));
+  return values[index];
+}
+
+static void getScenarioStart(const Scenario &scenario, double &startX, double &startY) {
+  startX = (double(1 << scenario.zoom) / 2 + 0.37) * BENCH_TILE_SIZE;
+  startY = (double(1 << scenario.zoom) / 3 + 0.61) * BENCH_TILE_SIZE;
+}
+
+// Location of given measured frame, warmup frames stay at the start
+static void getFrameLocation(const Scenario &scenario, double startX, double startY, uint32_t step,
+                             Location &location) {
+  pixelToLatLong(startX + scenario.stepX * step, startY + scenario.stepY * step, scenario.zoom,
+                 location.latitude, location.longitude);
+  location.heading = std::fmod(scenario.heading + scenario.headingStep * step, 360.0);
+}
+
+// Segments of the route drawn by renderMap at given location
+static void collectRouteSegments(Tour &tour, const Location &location, uint8_t zoom,
+                                 std::vector<RouteSegment> &segments) {
+  segments.clear();
+  auto locationTileXY = Tile::convertLatLongToTileXY(location.latitude, location.longitude, zoom);
+  const double rotationRad = -location.heading * M_PI / 180.0;
+  const double cosine = std::cos(rotationRad);
+  const double sine = std::sin(rotationRad);
+
+  auto tourLock = tour.lockIndex();
+  const Tour::ClusteredPoints &points = tour.getClusteredPoints();
+  for (const auto &range: tour.getNearbyPoints(location.latitude, location.longitude, BENCH_ROUTE_TILE_RADIUS)) {
+    for (uint32_t i = range.begin; i < range.end; i++) {
+      const uint32_t next = points.nextPoint[i];
+      if (next == TOUR_NO_POINT) {
+        continue;
+      }
+      const double startX = (points.tileX[i] - locationTileXY.first) * BENCH_TILE_SIZE;
+      const double startY = (points.tileY[i] - locationTileXY.second) * BENCH_TILE_SIZE;
+      const double endX = (points.tileX[next] - locationTileXY.first) * BENCH_TILE_SIZE;
+      const double endY = (points.tileY[next] - locationTileXY.second) * BENCH_TILE_SIZE;
+      segments.push_back({cosine * startX - sine * startY, sine * startX + cosine * startY,
+                          cosine * endX - sine * endY, sine * endX + cosine * endY});
+    }
+  }
+}
+
+static void drawRouteWithRasterizer(const std::vector<RouteSegment> &segments, PolylineRasterizer &rasterizer,
+                                    uint16_t *buffer) {
+  rasterizer.begin(TOUR_LINE_WIDTH * POLYLINE_SUBPIXEL_SCALE);
+  for (const auto &segment: segments) {
+    int32_t startX, startY, endX, endY;
+    if (!centerAndTrimLineSegment(segment.startX, segment.startY, segment.endX, segment.endY,
+                                  MAP_WIDTH, MAP_HEIGHT, TOUR_LINE_WIDTH, startX, startY, endX, endY)) {
+      rasterizer.addSegment(startX, startY, endX, endY);
+    }
+  }
+  rasterizer.finish(buffer, BENCH_ROUTE_COLOR);
+}
+
+// Route drawing before PolylineRasterizer: segments clipped to the map and drawn by Paint_DrawLine
+static void drawRouteWithPaint(const std::vector<RouteSegment> &segments, uint16_t *buffer) {
+  Paint_NewImage(buffer, MAP_WIDTH, MAP_HEIGHT, 0, WHITE, 24);
+  const double maxX = MAP_WIDTH - 1;
+  const double maxY = MAP_HEIGHT - 1;
+  for (const auto &segment: segments) {
+    const double startX = MAP_WIDTH / 2.0 + segment.startX;
+    const double startY = MAP_HEIGHT / 2.0 + segment.startY;
+    const double endX = MAP_WIDTH / 2.0 + segment.endX;
+    const double endY = MAP_HEIGHT / 2.0 + segment.endY;
+    if ((startX < 0 && endX < 0) || (startY < 0 && endY < 0) ||
+        (startX > maxX && endX > maxX) || (startY > maxY && endY > maxY)) {
+      continue;
+    }
+    double clippedStartX, clippedStartY, clippedEndX, clippedEndY;
+    if (clipLineSegment(startX, startY, endX, endY, 0.0, 0.0, maxX, maxY,
+                        clippedStartX, clippedStartY, clippedEndX, clippedEndY)) {
+      continue;
+    }
+    Paint_DrawLine(int16_t(std::lround(clippedStartX)), int16_t(std::lround(clippedStartY)),
+                   int16_t(std::lround(clippedEndX)), int16_t(std::lround(clippedEndY)),
+                   BENCH_ROUTE_COLOR, DOT_PIXEL_2X2, LINE_STYLE_SOLID);
+  }
+}
+
+// Times clipping and drawing of the route at the frame locations of the scenario, both ways
+static void runRouteStage(const Scenario &scenario, const Options &options) {
+  double startX, startY;
+  getScenarioStart(scenario, startX, startY);
+  Tour tour;
+  createRoute(scenario, startX, startY, tour);
+
+  PolylineRasterizer rasterizer(MAP_WIDTH, MAP_HEIGHT);
+  std::vector<uint16_t> buffer(MAP_WIDTH * MAP_HEIGHT);
+  std::vector<RouteSegment> segments;
+  std::vector<double> rasterizerTimes;
+  std::vector<double> paintTimes;
+  size_t segmentsCount = 0;
+  Location location{};
+  for (uint32_t step = 0; step < options.frames; step++) {
+    getFrameLocation(scenario, startX, startY, step, location);
+    collectRouteSegments(tour, location, scenario.zoom, segments);
+    segmentsCount += segments.size();
+
+    auto stageStart = std::chrono::steady_clock::now();
+    drawRouteWithRasterizer(segments, rasterizer, buffer.data());
+    auto stageEnd = std::chrono::steady_clock::now();
+    rasterizerTimes.push_back(std::chrono::duration<double, std::milli>(stageEnd - stageStart).count());
+
+    stageStart = std::chrono::steady_clock::now();
+    drawRouteWithPaint(segments, buffer.data());
+    stageEnd = std::chrono::steady_clock::now();
+    paintTimes.push_back(std::chrono::duration<double, std::milli>(stageEnd - stageStart).count());
+  }
+
+  printf("%-18s route     rasterizer p50 %7.3f ms  p99 %7.3f ms  Paint_DrawLine p50 %7.3f ms  p99 %7.3f ms  "
+         "%5.0f segments/frame\n",
+         scenario.name, percentile(rasterizerTimes, 0.5), percentile(rasterizerTimes, 0.99),
+         percentile(paintTimes, 0.5), percentile(paintTimes, 0.99), double(segmentsCount) / options.frames);
+}
+
+static bool runScenario(const Scenario &scenario, const Options &options, const std::string &threadsLabel) {
+  double startX, startY;
+  getScenarioStart(scenario, startX, startY);
+  const auto startTileX = uint32_t(startX / BENCH_TILE_SIZE);
+  const auto startTileY = uint32_t(startY / BENCH_TILE_SIZE);
+
+  std::map<std::string, Tile *> tiles;
+  for (int32_t i = -BENCH_TILES_RADIUS; i <= BENCH_TILES_RADIUS; i++) {
+    for (int32_t j = -BENCH_TILES_RADIUS; j <= BENCH_TILES_RADIUS; j++) {
+      Tile *tile = createSyntheticTile(startTileX + i, startTileY + j, scenario.zoom);
+      tiles[tile->key] = tile;
+    }
+  }
+  Tour tour;
+  createRoute(scenario, startX, startY, tour);
+
+  bool passed = true;
+  for (const auto &samplingMode: samplingModes) {
+    renderer::setMapSamplingMode(samplingMode.mode);
+    renderer::invalidateMapCache();
+
+    Location location{};
+    location.accuracy = 12;
+    std::vector<double> frameTimes;
+    std::vector<double> mapLayerTimes;
+    std::vector<double> tourTimes;
+    frameTimes.reserve(options.frames);
+    mapLayerTimes.reserve(options.frames);
+    tourTimes.reserve(options.frames);
+    std::vector<uint8_t> goldenFrame;
+    const uint64_t startBytes = DEV_Mock_GetTransferredBytes();
+    const uint32_t frameCount = BENCH_WARMUP_FRAMES + std::max(options.frames, uint32_t(BENCH_GOLDEN_STEP + 1));
+
+    for (uint32_t frame = 0; frame < frameCount; frame++) {
+      const uint32_t step = frame < BENCH_WARMUP_FRAMES ? 0 : frame - BENCH_WARMUP_FRAMES;
+      getFrameLocation(scenario, startX, startY, step, location);
+
+      auto frameStart = std::chrono::steady_clock::now();
+      renderer::renderMap(tiles, tour, location, scenario.zoom);
+      auto frameEnd = std::chrono::steady_clock::now();
+      if (frame >= BENCH_WARMUP_FRAMES && step < options.frames) {
+        frameTimes.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+        mapLayerTimes.push_back(renderer::getLastMapRenderTimes().mapLayer);
+        tourTimes.push_back(renderer::getLastMapRenderTimes().tour);
+      }
+      if (frame >= BENCH_WARMUP_FRAMES && step == BENCH_GOLDEN_STEP) {
+        goldenFrame = captureMap();
+      }
+    }
+
+    std::string status = "not checked";
+    if (!options.goldenDirectory.empty()) {
+      const std::string path =
+          options.goldenDirectory + "/" + scenario.name + "_" + samplingMode.name + ".png";
+      passed = checkGoldenImage(goldenFrame, path, options, status) && passed;
+    }
+
+    const double bytesPerFrame =
+        double(DEV_Mock_GetTransferredBytes() - startBytes) / double(frameCount);
+    printf("%-18s %-9s %sp50 %7.3f ms  p99 %7.3f ms  (map %6.3f, route %6.3f ms)  %6.0f KB/frame  golden: %s\n",
+           scenario.name, samplingMode.name, threadsLabel.c_str(), percentile(frameTimes, 0.5),
+           percentile(frameTimes, 0.99), percentile(mapLayerTimes, 0.5), percentile(tourTimes, 0.5),
+           bytesPerFrame / 1024.0, status.c_str());
+  }
+
+  for (const auto &tile: tiles) {
+    delete tile.second;
+  }
+  return passed;
+}
+
+// Parses comma separated counts, false if any is not a number from minimum to maximum
+static bool parseCounts(const char *argument, uint32_t minimum, uint32_t maximum, std::vector<uint32_t> &counts) {
+  counts.clear();
+  const char *position = argument;
+  while (*position != '\0') {
+    char *end;
+    const long count = strtol(position, &end, 10);
+    if (end == position || count < long(minimum) || count > long(maximum) || (*end != ',' && *end != '\0')) {
+      return false;
+    }
+    counts.push_back(uint32_t(count));
+    position = *end == ',' ? end + 1 : end;
+  }
+  return !counts.empty();
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options) {
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (argument == "--frames" && hasValue) {
+      options.frames = uint32_t(std::max(1, atoi(argv[++i])));
+    } else if (argument == "--scenario" && hasValue) {
+      options.scenario = argv[++i];
+    } else if (argument == "--golden" && hasValue) {
+      options.goldenDirectory = argv[++i];
+    } else if (argument == "--update-golden") {
+      options.updateGolden = true;
+    } else if (argument == "--tolerance" && hasValue) {
+      options.tolerance = atoi(argv[++i]);
+    } else if (argument == "--workers" && hasValue) {
+      if (!parseCounts(argv[++i], 0, UINT8_MAX, options.workerCounts)) {
+        fprintf(stderr, "Invalid worker counts %s\n", argv[i]);
+        return false;
+      }
+    } else if (argument == "--bands" && hasValue) {
+      if (!parseCounts(argv[++i], 1, UINT16_MAX, options.bandCounts)) {
+        fprintf(stderr, "Invalid band counts %s\n", argv[i]);
+        return false;
+      }
+    } else {
+      fprintf(stderr,
+              "Usage: %s [--frames N] [--scenario NAME] [--golden DIR] [--update-golden] [--tolerance N]\n"
+              "       [--workers N,...] [--bands N,...]\n",
+              argv[0]);
+      return false;
+    }
+  }
+  if (options.updateGolden && options.goldenDirectory.empty()) {
+    fprintf(stderr, "--update-golden requires --golden DIR\n");
+    return false;
+  }
+  if (options.workerCounts.empty() != options.bandCounts.empty()) {
+    // Sweeps of one of them keep the other at its default
+    options.workerCounts.empty() ? options.workerCounts.push_back(MAP_RENDER_WORKERS)
+                                 : options.bandCounts.push_back(MAP_RENDER_BANDS);
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  bool passed = true;
+  bool found = false;
+  for (const auto &scenario: scenarios) {
+    if (!options.scenario.empty() && options.scenario != scenario.name) {
+      continue;
+    }
+    found = true;
+    runRouteStage(scenario, options);
+    if (options.workerCounts.empty()) {
+      passed = runScenario(scenario, options, "") && passed;
+      continue;
+    }
+    for (uint32_t workerCount: options.workerCounts) {
+      for (uint32_t bandCount: options.bandCounts) {
+        renderer::setMapRenderThreads(uint8_t(workerCount), uint16_t(bandCount));
+        char threadsLabel[32];
+        snprintf(threadsLabel, sizeof(threadsLabel), "%2u workers %3u bands  ", workerCount, bandCount);
+        passed = runScenario(scenario, options, threadsLabel) && passed;
+      }
+    }
+  }
+  if (!found) {
+    fprintf(stderr, "Unknown scenario %s\n", options.scenario.c_str());
+    return 2;
+  }
+  return passed ? 0 : 1;
+}
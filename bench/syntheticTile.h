@@ -0,0 +1,50 @@
+#ifndef BIKETOURASSISTANT_SYNTHETICTILE_H
+#define BIKETOURASSISTANT_SYNTHETICTILE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static inline uint32_t hashCell(int64_t x, int64_t y) {
+  auto hash = uint32_t(x * 73856093) ^ uint32_t(y * 19349663);
+  hash ^= hash >> 13;
+  hash *= 0x5bd1e995;
+  return hash ^ (hash >> 15);
+}
+
+/**
+ * RGB image of a street map look-alike tile, drawn from global pixel coordinates so adjacent tiles join seamlessly:
+ * blocks of land, parks and water separated by a street grid and diagonal avenues.
+ * */
+static inline std::vector<uint8_t> createSyntheticTileImage(uint32_t tileX, uint32_t tileY, uint16_t tileSize) {
+  std::vector<uint8_t> imageData(size_t(tileSize) * tileSize * 3);
+
+  for (uint16_t v = 0; v < tileSize; v++) {
+    for (uint16_t u = 0; u < tileSize; u++) {
+      const int64_t x = int64_t(tileX) * tileSize + u;
+      const int64_t y = int64_t(tileY) * tileSize + v;
+      const int64_t streetX = std::abs(x % 48 - 24);
+      const int64_t streetY = std::abs(y % 48 - 24);
+      const int64_t avenue = std::abs((x + y) % 181 - 90);
+      const uint32_t block = hashCell(x / 48, y / 48);
+
+      uint8_t color[3] = {242, 239, 233};
+      if (avenue < 3) {
+        color[0] = 247, color[1] = 250, color[2] = 191;
+      } else if (avenue < 5 || streetX < 2 || streetY < 2) {
+        color[0] = color[1] = color[2] = 255;
+      } else if (streetX < 3 || streetY < 3) {
+        color[0] = 200, color[1] = 196, color[2] = 190;
+      } else if (block % 7 == 0) {
+        color[0] = 200, color[1] = 230, color[2] = 190;
+      } else if (block % 11 == 0) {
+        color[0] = 170, color[1] = 211, color[2] = 223;
+      }
+      memcpy(&imageData[(size_t(v) * tileSize + u) * 3], color, 3);
+    }
+  }
+  return imageData;
+}
+
+#endif //BIKETOURASSISTANT_SYNTHETICTILE_H
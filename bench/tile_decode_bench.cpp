@@ -0,0 +1,216 @@
+/**
+ * Tile decoding benchmark. Decodes PNG tiles with the previous lodepng RGB path and with the tile decoding
+ * path (palette PNGs kept as indices plus an RGB565 palette, other PNGs indexed after decoding, inflate by
+ * system zlib when built with USE_SYSTEM_ZLIB) and reports p50/p95 decode times per tile. Decoded tiles
+ * are checked to match.
+ *
+ * Tiles are synthetic street map tiles encoded as RGB and palette PNGs, or the PNG files of a tiles cache
+ * directory, e.g. one copied from the device.
+ *
+ * Usage: tile_decode_bench [--iterations N (default 50)] [--tiles DIR]
+ * */
+#include "core/tileDecoder.h"
+#include "lodepng/lodepng.h"
+#include "pngUtils.h"
+#include "syntheticTile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifdef USE_SYSTEM_ZLIB
+#include <zlib.h>
+#endif
+
+#define BENCH_TILE_SIZE 256
+#define BENCH_SYNTHETIC_TILES 4 // Per side
+
+struct Options {
+  uint32_t iterations = 50;
+  std::string tilesDirectory;
+};
+
+struct TileSet {
+  std::string name;
+  std::vector<std::vector<uint8_t>> pngFiles;
+};
+
+// Returns width and height of the decoded tile, 0, 0 on error
+typedef std::function<std::pair<uint16_t, uint16_t>(const std::vector<uint8_t> &png)> DecodePath;
+
+static double percentile(std::vector<double> values, double fraction) {
+  std::sort(values.begin(), values.end());
+  auto index = size_t(std::lround(fraction * double(values.size() - 1)));
+  return values[index];
+}
+
+static std::vector<uint8_t> encodePng(const std::vector<uint8_t> &image, bool palette) {
+  lodepng::State state;
+  // Automatic conversion picks a palette for images of few colors, as tile servers do
+  state.encoder.auto_convert = palette ? 1 : 0;
+  state.info_png.color.colortype = LCT_RGB;
+  state.info_raw.colortype = LCT_RGB;
+  std::vector<uint8_t> png;
+  lodepng::encode(png, image, BENCH_TILE_SIZE, BENCH_TILE_SIZE, state);
+  return png;
+}
+
+static std::vector<TileSet> createSyntheticTileSets() {
+  TileSet rgbTiles = {"synthetic RGB PNG", {}};
+  TileSet paletteTiles = {"synthetic palette PNG", {}};
+  for (uint32_t i = 0; i < BENCH_SYNTHETIC_TILES * BENCH_SYNTHETIC_TILES; i++) {
+    auto image = createSyntheticTileImage(36408 + i % BENCH_SYNTHETIC_TILES, 22180 + i / BENCH_SYNTHETIC_TILES,
+                                          BENCH_TILE_SIZE);
+    rgbTiles.pngFiles.push_back(encodePng(image, false));
+    paletteTiles.pngFiles.push_back(encodePng(image, true));
+  }
+  return {rgbTiles, paletteTiles};
+}
+
+static bool loadTileSet(const std::string &directory, TileSet &tileSet) {
+  DIR *dir = opendir(directory.c_str());
+  if (dir == nullptr) {
+    fprintf(stderr, "Cannot open tiles directory %s\n", directory.c_str());
+    return false;
+  }
+  tileSet.name = directory;
+  while (dirent *entry = readdir(dir)) {
+    const std::string name = entry->d_name;
+    if (name.size() < 4 || name.compare(name.size() - 4, 4, ".png") != 0) {
+      continue;
+    }
+    std::vector<uint8_t> png;
+    if (lodepng::load_file(png, directory + "/" + name) == 0 && !png.empty()) {
+      tileSet.pngFiles.push_back(png);
+    }
+  }
+  closedir(dir);
+  if (tileSet.pngFiles.empty()) {
+    fprintf(stderr, "No PNG tiles in %s\n", directory.c_str());
+    return false;
+  }
+  return true;
+}
+
+static void runDecodePath(const TileSet &tileSet, const char *name, const DecodePath &decode,
+                          const Options &options) {
+  std::vector<double> decodeTimes;
+  decodeTimes.reserve(tileSet.pngFiles.size() * options.iterations);
+  uint32_t failures = 0;
+  for (uint32_t iteration = 0; iteration < options.iterations; iteration++) {
+    for (const auto &png: tileSet.pngFiles) {
+      auto decodeStart = std::chrono::steady_clock::now();
+      auto tileResolution = decode(png);
+      auto decodeEnd = std::chrono::steady_clock::now();
+      decodeTimes.push_back(std::chrono::duration<double, std::micro>(decodeEnd - decodeStart).count());
+      failures += tileResolution.first == 0 ? 1 : 0;
+    }
+  }
+  printf("  %-26s p50 %8.0f us  p95 %8.0f us", name, percentile(decodeTimes, 0.5), percentile(decodeTimes, 0.95));
+  if (failures > 0) {
+    printf("  (%u of %zu tiles not decoded)", failures / options.iterations, tileSet.pngFiles.size());
+  }
+  printf("\n");
+}
+
+// Tile decoder output has to match lodepng's RGB decoding at RGB565, the precision of the display.
+// Tiles of more than 256 RGB565 colors are approximated by the decoder and reported as mismatching.
+static uint32_t countMismatchingTiles(const TileSet &tileSet) {
+  uint32_t mismatches = 0;
+  for (const auto &png: tileSet.pngFiles) {
+    std::vector<uint8_t> expected;
+    unsigned width, height;
+    lodepng::decode(expected, width, height, png, LCT_RGB);
+    std::vector<uint8_t> indices;
+    Rgb565Palette palette;
+    TileDecoder::forFormat(TILE_FORMAT_PNG)->decode(indices, palette, png.data(), uint32_t(png.size()));
+
+    bool matches = indices.size() * 3 == expected.size();
+    for (size_t i = 0; matches && i < indices.size(); i++) {
+      const uint8_t *pixel = &expected[i * 3];
+      matches = palette[indices[i]] == uint16_t(((pixel[0] >> 3) << 11) | ((pixel[1] >> 2) << 5) | (pixel[2] >> 3));
+    }
+    mismatches += matches ? 0 : 1;
+  }
+  return mismatches;
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options) {
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (argument == "--iterations" && hasValue) {
+      options.iterations = uint32_t(std::max(1, atoi(argv[++i])));
+    } else if (argument == "--tiles" && hasValue) {
+      options.tilesDirectory = argv[++i];
+    } else {
+      fprintf(stderr, "Usage: %s [--iterations N] [--tiles DIR]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  std::vector<TileSet> tileSets;
+  if (options.tilesDirectory.empty()) {
+    tileSets = createSyntheticTileSets();
+  } else {
+    TileSet tileSet;
+    if (!loadTileSet(options.tilesDirectory, tileSet)) {
+      return 2;
+    }
+    tileSets.push_back(tileSet);
+  }
+
+#ifdef USE_SYSTEM_ZLIB
+  printf("Inflate: system zlib %s\n", zlibVersion());
+#else
+  printf("Inflate: lodepng\n");
+#endif
+
+  bool passed = true;
+  for (const auto &tileSet: tileSets) {
+    size_t totalBytes = 0;
+    for (const auto &png: tileSet.pngFiles) {
+      totalBytes += png.size();
+    }
+    printf("%s: %zu tiles, %zu bytes on average\n", tileSet.name.c_str(), tileSet.pngFiles.size(),
+           totalBytes / tileSet.pngFiles.size());
+
+    std::vector<uint8_t> imageData;
+    runDecodePath(tileSet, "lodepng RGB (previous)", [&](const std::vector<uint8_t> &png) {
+      unsigned width, height;
+      unsigned error = lodepng::decode(imageData, width, height, png, LCT_RGB);
+      return error ? std::make_pair(uint16_t(0), uint16_t(0)) : std::make_pair(uint16_t(width), uint16_t(height));
+    }, options);
+    runDecodePath(tileSet, "parsePngData", [&](const std::vector<uint8_t> &png) {
+      return parsePngData(imageData, png.data(), uint32_t(png.size()));
+    }, options);
+    Rgb565Palette palette;
+    runDecodePath(tileSet, "parsePalettePngData", [&](const std::vector<uint8_t> &png) {
+      return parsePalettePngData(imageData, palette, png.data(), uint32_t(png.size()));
+    }, options);
+    runDecodePath(tileSet, "TileDecoder PNG", [&](const std::vector<uint8_t> &png) {
+      return TileDecoder::forFormat(TILE_FORMAT_PNG)->decode(imageData, palette, png.data(), uint32_t(png.size()));
+    }, options);
+
+    const uint32_t mismatches = countMismatchingTiles(tileSet);
+    if (mismatches > 0) {
+      printf("  MISMATCH in %u tiles\n", mismatches);
+      passed = false;
+    }
+  }
+  return passed ? 0 : 1;
+}
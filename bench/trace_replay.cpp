@@ -0,0 +1,316 @@
+/**
+ * Replays a bluetooth trace recorded with `BikeTourAssistant --trace FILE` through handleMessage and the regular
+ * core and renderer, against mocked LCD and bluetooth server. Inbound messages are fed either at recorded speed
+ * or as fast as possible, display updates run every 16 ms of trace time like the display thread does.
+ * Reports handleMessage and redraw times and compares sent messages with the recorded outbound traffic.
+ *
+ * With --threaded, display updates run on their own thread every 16 ms of wall time as on the device, and times
+ * of messages handled while a redraw runs (the map workers filling it) are reported separately.
+ * --workers and --bands set the map render worker and band counts.
+ *
+ * Tiles are cached in a temporary directory, so tile requests do not depend on an earlier replay.
+ *
+ * Usage: trace_replay [--realtime] [--no-display] [--threaded] [--workers N] [--bands N] TRACE_FILE
+ * */
+#include "bluetooth/messageHandler.h"
+#include "bluetooth/messageTrace.h"
+#include "core/core.h"
+#include "core/renderer.h"
+#include "core/tile.h"
+#include "mock/bluetoothServerMock.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define REPLAY_FRAME_INTERVAL 16000 // microseconds, as the display thread in main.cpp
+#define REPLAY_MESSAGE_BUFFER_SIZE 244 // Largest characteristic value btlib passes to le_value_callback
+#define REPLAY_MESSAGE_TYPES 32 // Counted inbound types, known ones end at MESSAGE_IN_LOCATION_UPDATE_DELTA
+
+struct Options {
+  std::string tracePath;
+  bool realtime = false;
+  bool display = true;
+  bool threaded = false;
+  uint8_t workerCount = MAP_RENDER_WORKERS;
+  uint16_t bandCount = MAP_RENDER_BANDS;
+};
+
+struct ReplayStats {
+  uint32_t messageCounts[REPLAY_MESSAGE_TYPES] = {0};
+  uint32_t skippedPhotos = 0;
+  uint32_t connections = 0;
+  std::vector<double> handleTimes; // microseconds
+  std::vector<double> handleTimesDuringRedraw; // microseconds, of messages handled while a threaded redraw ran
+  std::vector<double> redrawTimes; // milliseconds
+  std::vector<std::vector<uint8_t>> recordedOutbound;
+  std::vector<std::vector<uint8_t>> replayedOutbound;
+};
+
+// Set by the display thread of a threaded replay while it redraws
+static std::atomic<bool> isRedrawing(false);
+// Connections are set up as on the display thread, not in the middle of a display update
+static std::mutex displayMutex;
+
+static double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  std::sort(values.begin(), values.end());
+  auto index = size_t(std::lround(fraction * double(values.size() - 1)));
+  return values[index];
+}
+
+static void collectSentMessages(ReplayStats &stats) {
+  for (auto &message: takeSentBluetoothMessages()) {
+    stats.replayedOutbound.push_back(std::move(message));
+  }
+}
+
+static void connect(ReplayStats &stats) {
+  // Same sequence as the display thread runs after the intro view
+  CORE.isBluetoothConnected = true;
+  resetLocationKeyframe(); // As le_callback on LE_CONNECT
+  resetOutMessagesQueue();
+  renderer::prepareMainView();
+  CORE.reset();
+  stats.connections++;
+}
+
+static void runDisplayUpdate(const Options &options, ReplayStats &stats) {
+  if (!CORE.isBluetoothConnected) {
+    return;
+  }
+  CORE.update();
+  if (options.display) {
+    auto startTime = std::chrono::steady_clock::now();
+    isRedrawing = true;
+    CORE.redraw();
+    isRedrawing = false;
+    auto endTime = std::chrono::steady_clock::now();
+    stats.redrawTimes.push_back(std::chrono::duration<double, std::milli>(endTime - startTime).count());
+  }
+  if (!options.threaded) {
+    // Messages are only sent while handling inbound ones, a threaded replay collects them there
+    collectSentMessages(stats);
+  }
+}
+
+// Display thread of a threaded replay, as displayThread in main.cpp
+static void runDisplayThread(const Options &options, ReplayStats &stats, const std::atomic<bool> &isReplaying) {
+  while (isReplaying) {
+    {
+      std::lock_guard<std::mutex> lock(displayMutex);
+      runDisplayUpdate(options, stats);
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(REPLAY_FRAME_INTERVAL));
+  }
+}
+
+static void handleInboundMessage(const std::vector<uint8_t> &data, ReplayStats &stats) {
+  if (data.empty()) {
+    return;
+  }
+  // Copied out of the record as le_value_callback passes a value of at most one characteristic buffer
+  uint8_t buffer[REPLAY_MESSAGE_BUFFER_SIZE];
+  const auto length = int(std::min(data.size(), sizeof(buffer)));
+  memcpy(buffer, data.data(), size_t(length));
+
+  if (buffer[0] == 3) {
+    // TAKE_PHOTO would run libcamera-still and write into the photos directory
+    stats.skippedPhotos++;
+    return;
+  }
+  if (buffer[0] < REPLAY_MESSAGE_TYPES) {
+    stats.messageCounts[buffer[0]]++;
+  }
+
+  const bool duringRedraw = isRedrawing;
+  auto startTime = std::chrono::steady_clock::now();
+  handleMessage(buffer, length);
+  auto endTime = std::chrono::steady_clock::now();
+  (duringRedraw ? stats.handleTimesDuringRedraw : stats.handleTimes)
+      .push_back(std::chrono::duration<double, std::micro>(endTime - startTime).count());
+  collectSentMessages(stats);
+}
+
+// Runs display updates due until given trace time, returns time of the next one
+static uint64_t advanceTo(uint64_t traceTime, uint64_t nextFrameTime,
+                          std::chrono::steady_clock::time_point replayStart,
+                          const Options &options, ReplayStats &stats) {
+  if (!options.realtime) {
+    // Display state only changes on messages, so one update covers any number of skipped frames
+    if (traceTime >= nextFrameTime) {
+      runDisplayUpdate(options, stats);
+      nextFrameTime = traceTime + REPLAY_FRAME_INTERVAL;
+    }
+    return nextFrameTime;
+  }
+
+  while (nextFrameTime <= traceTime) {
+    std::this_thread::sleep_until(replayStart + std::chrono::microseconds(nextFrameTime));
+    runDisplayUpdate(options, stats);
+    nextFrameTime += REPLAY_FRAME_INTERVAL;
+  }
+  std::this_thread::sleep_until(replayStart + std::chrono::microseconds(traceTime));
+  return nextFrameTime;
+}
+
+static void printReport(const ReplayStats &stats, uint64_t traceDuration, double replayDuration) {
+  uint32_t inboundCount = 0;
+  printf("Message counts by type:");
+  for (uint8_t type = 0; type < REPLAY_MESSAGE_TYPES; type++) {
+    if (stats.messageCounts[type] > 0) {
+      printf(" %u:%u", type, stats.messageCounts[type]);
+      inboundCount += stats.messageCounts[type];
+    }
+  }
+  printf("\n");
+  if (stats.skippedPhotos > 0) {
+    printf("Skipped photo requests: %u\n", stats.skippedPhotos);
+  }
+
+  printf("Connections: %u, trace duration %.3f s, replayed in %.3f s (%.0f messages/s)\n",
+         stats.connections, double(traceDuration) / 1e6, replayDuration,
+         replayDuration > 0 ? double(inboundCount) / replayDuration : 0.0);
+  printf("handleMessage: p50 %8.2f us  p99 %8.2f us  max %8.2f us\n",
+         percentile(stats.handleTimes, 0.5), percentile(stats.handleTimes, 0.99),
+         percentile(stats.handleTimes, 1.0));
+  if (!stats.handleTimesDuringRedraw.empty()) {
+    printf("  during redraw (%zu): p50 %8.2f us  p99 %8.2f us  max %8.2f us\n",
+           stats.handleTimesDuringRedraw.size(), percentile(stats.handleTimesDuringRedraw, 0.5),
+           percentile(stats.handleTimesDuringRedraw, 0.99), percentile(stats.handleTimesDuringRedraw, 1.0));
+  }
+  if (!stats.redrawTimes.empty()) {
+    printf("redraw (%zu):   p50 %8.3f ms  p99 %8.3f ms  max %8.3f ms\n",
+           stats.redrawTimes.size(), percentile(stats.redrawTimes, 0.5), percentile(stats.redrawTimes, 0.99),
+           percentile(stats.redrawTimes, 1.0));
+  }
+
+  size_t matching = 0;
+  const size_t compared = std::min(stats.recordedOutbound.size(), stats.replayedOutbound.size());
+  for (size_t i = 0; i < compared; i++) {
+    if (stats.recordedOutbound[i] == stats.replayedOutbound[i]) {
+      matching++;
+    }
+  }
+  // Tiles cached on the recording device were not requested there, so tile requests may differ
+  printf("Outbound messages: recorded %zu, replayed %zu, identical %zu\n",
+         stats.recordedOutbound.size(), stats.replayedOutbound.size(), matching);
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options) {
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    if (argument == "--realtime") {
+      options.realtime = true;
+    } else if (argument == "--no-display") {
+      options.display = false;
+    } else if (argument == "--threaded") {
+      options.threaded = true;
+    } else if (argument == "--workers" && i + 1 < argc) {
+      options.workerCount = uint8_t(std::min(std::max(0, atoi(argv[++i])), int(UINT8_MAX)));
+    } else if (argument == "--bands" && i + 1 < argc) {
+      options.bandCount = uint16_t(std::min(std::max(1, atoi(argv[++i])), int(UINT16_MAX)));
+    } else if (options.tracePath.empty() && argument[0] != '-') {
+      options.tracePath = argument;
+    } else {
+      options.tracePath.clear();
+      break;
+    }
+  }
+  if (options.tracePath.empty()) {
+    fprintf(stderr, "Usage: %s [--realtime] [--no-display] [--threaded] [--workers N] [--bands N] TRACE_FILE\n",
+            argv[0]);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  MessageTraceReader reader;
+  if (!reader.open(options.tracePath)) {
+    fprintf(stderr, "Cannot read message trace %s\n", options.tracePath.c_str());
+    return 1;
+  }
+
+  // Assets are loaded relative to the executable, as for BikeTourAssistant
+  registerExecutablePath(argv[0]);
+  CORE.start();
+  renderer::setMapRenderThreads(options.workerCount, options.bandCount);
+  printf("Map render workers: %u, bands: %u%s\n", options.workerCount, options.bandCount,
+         options.threaded ? ", display updates on their own thread" : "");
+
+  char tilesCacheDirectory[] = "/tmp/trace_replay_tiles_XXXXXX";
+  if (mkdtemp(tilesCacheDirectory) == nullptr) {
+    fprintf(stderr, "Cannot create temporary tiles cache directory\n");
+    return 1;
+  }
+  Tile::setCacheDirectory(tilesCacheDirectory);
+
+  ReplayStats stats;
+  TraceRecord record;
+  uint64_t nextFrameTime = 0;
+  uint64_t traceDuration = 0;
+  const auto replayStart = std::chrono::steady_clock::now();
+  std::atomic<bool> isReplaying(true);
+  std::thread displayThread;
+  if (options.threaded) {
+    displayThread = std::thread(runDisplayThread, std::cref(options), std::ref(stats), std::cref(isReplaying));
+  }
+
+  while (reader.next(record)) {
+    if (!options.threaded) {
+      nextFrameTime = advanceTo(record.timestamp, nextFrameTime, replayStart, options, stats);
+    } else if (options.realtime) {
+      std::this_thread::sleep_until(replayStart + std::chrono::microseconds(record.timestamp));
+    }
+    traceDuration = record.timestamp;
+
+    switch (record.type) {
+      case TRACE_RECORD_CONNECT: {
+        std::lock_guard<std::mutex> lock(displayMutex);
+        connect(stats);
+        break;
+      }
+      case TRACE_RECORD_DISCONNECT:
+        CORE.isBluetoothConnected = false;
+        break;
+      case TRACE_RECORD_INBOUND:
+        handleInboundMessage(record.data, stats);
+        break;
+      case TRACE_RECORD_OUTBOUND:
+        stats.recordedOutbound.push_back(record.data);
+        break;
+      default:
+        fprintf(stderr, "Unknown trace record type %u\n", uint8_t(record.type));
+        break;
+    }
+  }
+  if (options.threaded) {
+    isReplaying = false;
+    displayThread.join();
+  } else {
+    runDisplayUpdate(options, stats);
+  }
+
+  const auto replayEnd = std::chrono::steady_clock::now();
+  printReport(stats, traceDuration, std::chrono::duration<double>(replayEnd - replayStart).count());
+
+  free(executeCommand((std::string("rm -rf ") + tilesCacheDirectory).c_str()));
+  return 0;
+}
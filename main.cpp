@@ -3,15 +3,16 @@
 #include "core/core.h"
 #include "core/renderer.h"
 #include "bluetooth/messageHandler.h"
+#include "bluetooth/messageTrace.h"
 #include "utils.h"
 
 #include <cstdlib>
 #include <csignal> //signal()
 #include <pthread.h>
 #include <iostream>
-#include <chrono>
+#include <string>
 
-void *bluetoothThread(void (*onMessage)(unsigned char *data)) {
+void *bluetoothThread(void (*onMessage)(unsigned char *data, int count)) {
   startBluetoothServer(onMessage);
   pthread_exit(nullptr);
   return nullptr;
@@ -30,37 +31,7 @@ void *displayThread(void *args) {
     while (CORE.isBluetoothConnected) {
       CORE.update();
 
-      if (CORE.needMapRedraw) {
-        CORE.needMapRedraw = false;
-
-        auto startTime = std::chrono::high_resolution_clock::now();
-
-        CORE.drawMap();
-
-        auto endTime = std::chrono::high_resolution_clock::now();
-        auto executionDuration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-        DEBUG("Map render took %lld milliseconds\n", executionDuration.count());
-      }
-
-      if (CORE.needSpeedRedraw) {
-        CORE.needSpeedRedraw = false;
-        renderer::drawSpeed(CORE.location.speed, CORE.getIcons());
-      }
-
-      if (CORE.needDirectionRedraw) {
-        CORE.needDirectionRedraw = false;
-        renderer::drawDirectionArrow(CORE.location.heading, CORE.getIcons());
-      }
-
-      if (CORE.needSlopeRedraw) {
-        CORE.needSlopeRedraw = false;
-        renderer::drawSlope(CORE.getSlope(), CORE.location.altitude, CORE.getIcons());
-      }
-
-      if (CORE.battery.needRedraw) {
-        CORE.battery.needRedraw = false;
-        renderer::drawBattery(CORE.battery.getPercentage(), CORE.battery.isOverheated());
-      }
+      CORE.redraw();
 
       // sleep for 16ms
       usleep(16 * 1000);
@@ -76,6 +47,13 @@ void terminate(int signo) {
 int main(int argc, char *argv[]) {
   registerExecutablePath(argv[0]);
 
+  for (int i = 1; i < argc; i++) {
+    // Records bluetooth traffic for bench/trace_replay
+    if (std::string(argv[i]) == "--trace" && i + 1 < argc) {
+      startMessageTrace(argv[++i]);
+    }
+  }
+
 #if USE_DEV_LIB
   std::cout << "Using dev lib" << std::endl;
 #endif
@@ -100,6 +78,7 @@ int main(int argc, char *argv[]) {
 
   pthread_join(bluetooth_thread_id, nullptr);
   pthread_cancel(display_thread_id);
+  stopMessageTrace();
 
   return 0;
 }
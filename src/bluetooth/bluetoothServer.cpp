@@ -1,8 +1,10 @@
 #include "bluetoothServer.h"
 
 #include "core/core.h"
+#include "messageTrace.h"
 #include "Debug.h"
 #include "utils.h"
+#include "messageHandler.h"
 
 #include <stdlib.h>
 
@@ -11,9 +13,12 @@ extern "C"
 #include "btferret/btlib.h"
 }
 
-int le_callback(int clientnode, int operation, int cticn, void (*onMessage)(unsigned char *data));
+int le_callback(int clientnode, int operation, int cticn, void (*onMessage)(unsigned char *data, int count));
 
-void startBluetoothServer(void (*onMessage)(unsigned char *data)) {
+int le_value_callback(int clientnode, int cticn, unsigned char *data, int count,
+                      void (*onMessage)(unsigned char *data, int count));
+
+void startBluetoothServer(void (*onMessage)(unsigned char *data, int count)) {
   int index;
   unsigned char buf[244], uuid[2];
 
@@ -37,6 +42,7 @@ void startBluetoothServer(void (*onMessage)(unsigned char *data)) {
   buf[1] = 0x34;
   write_ctic(localnode(), 4, buf, 0);
 
+  le_write_callback(le_value_callback); // Written values are passed to le_value_callback without a copy
   keys_to_callback(KEY_ON, 0); // OPTIONAL - key presses are sent to le_callback
   // with operation=LE_KEYPRESS and cticn=key code
   // The key that stops the server changes from x to ESC
@@ -48,22 +54,18 @@ void startBluetoothServer(void (*onMessage)(unsigned char *data)) {
   close_all();
 }
 
-int le_callback(int clientnode, int operation, int cticn, void (*onMessage)(unsigned char *data)) {
-  unsigned char buf[244];
-
+int le_callback(int clientnode, int operation, int cticn, void (*onMessage)(unsigned char *data, int count)) {
   if (operation == LE_CONNECT) {
     // clientnode has just connected
     DEBUG("Client %d has connected\n", clientnode);
+    traceMessage(TRACE_RECORD_CONNECT, nullptr, 0);
+    resetLocationKeyframe(); // New connection starts with a full location update
     CORE.isBluetoothConnected = true;
   } else if (operation == LE_READ) {
     // clientnode has just read local characteristic cticn
     // DEBUG("Client %d has read characteristic %d\n", clientnode, cticn);
   } else if (operation == LE_WRITE) {
-    // clientnode has just written local characteristic cticn
-    read_ctic(localnode(), cticn, buf, sizeof(buf)); // read characteristic to buf
-    // DEBUG("Client %d has written characteristic %d with data length: %lu\n", clientnode, cticn, sizeof(buf));
-    onMessage(buf);
-
+    // Not called, written values go to le_value_callback
   } else if (operation == LE_DISCONNECT) {
     // clientnode has just disconnected
     // uncomment next line to stop LE server when client disconnects
@@ -71,9 +73,11 @@ int le_callback(int clientnode, int operation, int cticn, void (*onMessage)(unsi
     // otherwise LE server will continue and wait for another connection
     // or operation from other clients that are still connected
     DEBUG("Client %d has disconnected\n", clientnode);
+    traceMessage(TRACE_RECORD_DISCONNECT, nullptr, 0);
     CORE.isBluetoothConnected = false;
   } else if (operation == LE_TIMER) {
     // The server timer calls here every timerds deci-seconds
+    CORE.indexStalledTour(); // Also checked on every received message
     // Data (index 6) is notify capable
     // so if the client has enabled notifications for this characteristic
     // the following write will send the data as a notification to the client
@@ -90,6 +94,16 @@ int le_callback(int clientnode, int operation, int cticn, void (*onMessage)(unsi
   return SERVER_CONTINUE;
 }
 
+int le_value_callback(int clientnode, int cticn, unsigned char *data, int count,
+                      void (*onMessage)(unsigned char *data, int count)) {
+  // clientnode has just written local characteristic cticn, data points into the received packet
+  traceMessage(TRACE_RECORD_INBOUND, data, uint16_t(count));
+  // DEBUG("Client %d has written characteristic %d with data length: %d\n", clientnode, cticn, count);
+  onMessage(data, count);
+  return SERVER_CONTINUE;
+}
+
 void sendBluetoothMessage(unsigned char *data) {
+  traceMessage(TRACE_RECORD_OUTBOUND, data, MESSAGE_OUT_SIZE);
   write_ctic(localnode(), 4, data, 0);
 }
\ No newline at end of file
@@ -1,7 +1,7 @@
 #ifndef __BLUETOOTH_SERVER_H
 #define __BLUETOOTH_SERVER_H
 
-void startBluetoothServer(void (*onMessage)(unsigned char *data));
+void startBluetoothServer(void (*onMessage)(unsigned char *data, int count));
 
 void sendBluetoothMessage(unsigned char *data);
 
@@ -230,6 +230,7 @@ struct globpar
   int btlenode;  // Notify node
   int blockflag;
   int hci;          // file desc for hci/acl commands sendhci/readhci
+  int hcitransport; // >0 = file desc set by hci_transport() used instead of hci user channel
   int devid;        // hciX number
   int bluez;        // 0/1 bluez down/up for server functions
   int timout;       // long time out for replies ms
@@ -266,6 +267,7 @@ struct globpar
   int settings;
   int keytocb; // keys to callback
   int maxpage;
+  int (*lewritecb)(int clientnode, int cticn, unsigned char *data, int count, void (*onMessage)(unsigned char *data, int count)); // set by le_write_callback()
 };
 
 struct globpar gpar;
@@ -365,7 +367,7 @@ void replysdp(int ndevice, int in, unsigned char *uuid, char *name);
 int addaid(unsigned char *sdp, unsigned char *aid, int *rn, int aidj, int aidk, int aidn);
 void rwlinkey(int rwflag, int ndevice, unsigned char *addr);
 int localctics();
-void leserver(int ndevice, int count, unsigned char *dat);
+int leserver(int ndevice, int count, unsigned char *dat);
 int nextctichandle(int start, int end, int *handle, int flag);
 int findcticuuid(int start, int end, unsigned char *uuidrev, int size);
 char *cticerrs(struct cticdata *cp);
@@ -439,7 +441,8 @@ int lepair(int ndevice);
 #define IN_ECHO ((long long int)1 << 39)
 #define IN_IOCAPRESP ((long long int)1 << 40) // HCI event 32
 #define IN_PAIRED ((long long int)1 << 41)    // HCI event 36
-#define IN_LECMD ((long long int)1 << 42)     // LE server operation
+#define IN_LECMD_BIT 42                       // Shift count, also stored as instack entry type
+#define IN_LECMD ((long long int)1 << IN_LECMD_BIT) // LE server operation
 #define IN_PASSREQ ((long long int)1 << 43)   // HCI event 34
 #define IN_PARAMREQ ((long long int)1 << 44)  // HCI event 3E/6
 #define IN_DATLEN ((long long int)1 << 45)    // HCI event 3E/7
@@ -3240,9 +3243,9 @@ void btle_notifynode(int node)
 
 /*********** LE SERVER ***********/
 
-int le_server(int (*callback)(int clientnode, int operation, int cticn, void (*onMessage)(unsigned char *data)), int timerds, void (*onMessage)(unsigned char *data))
+int le_server(int (*callback)(int clientnode, int operation, int cticn, void (*onMessage)(unsigned char *data, int count)), int timerds, void (*onMessage)(unsigned char *data, int count))
 {
-  int n, dn, key, ndevice, retval, timecount, oldkm, op, cticn, cbflag, flag;
+  int n, dn, key, ndevice, retval, timecount, oldkm, op, cticn, cbflag, flag, valn;
   struct devdata *dp;
   unsigned char *badd;
 
@@ -3284,13 +3287,18 @@ int le_server(int (*callback)(int clientnode, int operation, int cticn, void (*o
 
     cbflag = 0; // callback not called
 
-    n = findhci(IN_LECMD, 0, INS_POP);
+    n = findhci(IN_LECMD, 0, INS_LOCK);
     if (n >= 0)
     {
       ndevice = instack[n + 3];
       dp = dev[ndevice];
       op = insdatn[0];
       cticn = insdatn[1];
+      valn = -1;
+      if (op == LE_WRITE && gpar.lewritecb != NULL && instack[n + 1] + (instack[n + 2] << 8) > 2)
+        valn = n; // value kept by leserver - locked until write callback returns
+      else
+        instack[n] = INS_POP;
 
       if (op == LE_DISCONNECT)
         VPRINT "%s has disconnected\n",dp->name);
@@ -3342,7 +3350,15 @@ int le_server(int (*callback)(int clientnode, int operation, int cticn, void (*o
       flushprint();
       popins();
 
-      if (callback != NULL)
+      if (valn >= 0)
+      {
+        setkeymode(0);
+        retval = gpar.lewritecb(dp->node, cticn, insdat + valn + 3, insdat[valn + 2], onMessage);
+        setkeymode(1);
+        instack[valn] = INS_POP;
+        cbflag = 1;
+      }
+      else if (callback != NULL)
       {
         setkeymode(0);
         retval = callback(dp->node, op, cticn, onMessage);
@@ -3447,6 +3463,22 @@ int le_server(int (*callback)(int clientnode, int operation, int cticn, void (*o
   return (1);
 }
 
+/*********** LE WRITE CALLBACK ******
+callback = called by le_server instead of the le_server callback
+           with operation LE_WRITE. data points to the received
+           value of count bytes, valid until callback returns.
+           The value is not copied to the local characteristic
+           so read_ctic does not return it. NULL = LE_WRITE to
+           le_server callback
+return 1=OK
+*************************************/
+
+int le_write_callback(int (*callback)(int clientnode, int cticn, unsigned char *data, int count, void (*onMessage)(unsigned char *data, int count)))
+{
+  gpar.lewritecb = callback;
+  return (1);
+}
+
 int keys_to_callback(int flag, int keyboard)
 {
   if (flag == KEY_OFF)
@@ -6561,7 +6593,11 @@ void immediate(long long lookflag)
 
     if (gotflag == IN_ATTDAT && (dp->conflag & CON_LX) != 0)
     {
-      leserver(devicen, instack[n + 1] + (instack[n + 2] << 8), insdat + n);
+      if (leserver(devicen, instack[n + 1] + (instack[n + 2] << 8), insdat + n) != 0)
+      { // keep packet as LE_WRITE operation for le_server, value read in place
+        instack[n] = IN_LECMD_BIT;
+        continue;
+      }
     }
     else if (gotflag == IN_L2ASKCF)
     {
@@ -7219,10 +7255,10 @@ handles 0004...  characteristics
 
 ***********************/
 
-void leserver(int ndevice, int count, unsigned char *dat)
+int leserver(int ndevice, int count, unsigned char *dat)
 {
   int n, dn, cticn, flag, notflag, handle, start, end, startx, psflag, eog;
-  int size, uuidtype, aflag, xflag, acticn, ahandle, psn, locsize, datcount;
+  int size, uuidtype, aflag, xflag, acticn, ahandle, psn, locsize, datcount, keepflag;
   unsigned char cmd[2], *s, *data, errcode, buf[32];
   struct cticdata *cp;
 
@@ -7236,6 +7272,7 @@ void leserver(int ndevice, int count, unsigned char *dat)
   cmd[0] = 0;
   acticn = 0;
   ahandle = 0;
+  keepflag = 0; // 1 = write value stays in dat for le_write_callback()
   xflag = 0; // stop error
   // node = dev[0]->node;
 
@@ -7322,8 +7359,17 @@ void leserver(int ndevice, int count, unsigned char *dat)
               if (locsize > LEDATLEN)
                 locsize = LEDATLEN;
 
-              for (n = 0; n < locsize; ++n)
-                cp->value[n] = data[n];
+              if (gpar.lewritecb != NULL)
+              { // no copy to cp->value
+                if (datcount < locsize)
+                  locsize = datcount;
+                keepflag = 1;
+              }
+              else
+              {
+                for (n = 0; n < locsize; ++n)
+                  cp->value[n] = data[n];
+              }
 
               if (dat[0] == 0x12)
               { // no check cp->perm & 8 write with ack
@@ -7425,7 +7471,17 @@ void leserver(int ndevice, int count, unsigned char *dat)
     }
 
     if (errcode == 0 && notflag == 0 && flag != 0 && cmd[0] != 0)
+    {
+      if (keepflag != 0)
+      { // dat becomes LE_WRITE cticn count value... for le_server
+        dat[0] = cmd[0];
+        dat[1] = cmd[1];
+        dat[2] = (unsigned char)locsize;
+        flushprint();
+        return (1);
+      }
       pushins(IN_LECMD, ndevice, 2, cmd);
+    }
 
     if (flag == 0 && aflag == 0)
     {
@@ -7831,6 +7887,7 @@ void leserver(int ndevice, int count, unsigned char *dat)
   }
 
   flushprint();
+  return (0);
 }
 
 int nextctichandle(int start, int end, int *handle, int flag)
@@ -8500,6 +8557,12 @@ int bluezdown()
   if (gpar.bluez == 0)
     return (1); // already down
 
+  if (gpar.hcitransport > 0)
+  { // no hci device to take from bluez
+    gpar.bluez = 0;
+    return (1);
+  }
+
   VPRINT "Bluez down\n");
 
   retval = 0;
@@ -8536,34 +8599,43 @@ int hcisock()
   if (gpar.hci > 0)
     return (1);
 
-  VPRINT "Open HCI user socket\n");
-
-  // AF_BLUETOOTH=31
-  VPRINT "Open BTPROTO socket\n");
-  dd = socket(31, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, BTPROTO_HCI);
-
-  if (dd < 0)
+  if (gpar.hcitransport > 0)
   {
-    VPRINT "Socket open error\n");
-    flushprint();
-    return (0);
+    VPRINT "Use HCI transport %d\n",gpar.hcitransport);
+    dd = gpar.hcitransport;
+    fcntl(dd, F_SETFL, fcntl(dd, F_GETFL) | O_NONBLOCK); // as user socket
   }
+  else
+  {
+    VPRINT "Open HCI user socket\n");
 
-  VPRINT "Bind to Bluetooth devid user channel\n");
+    // AF_BLUETOOTH=31
+    VPRINT "Open BTPROTO socket\n");
+    dd = socket(31, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, BTPROTO_HCI);
 
-  sa[0] = 31; // hci_family = AF_BLUETOOTH
-  sa[1] = 0;
-  sa[2] = gpar.devid & 0xFF; // hci_dev = hci0/1/2...
-  sa[3] = (gpar.devid >> 8) & 0xFF;
-  sa[4] = 1; // hci_channel = HCI_CHANNEL_USER
-  sa[5] = 0;
+    if (dd < 0)
+    {
+      VPRINT "Socket open error\n");
+      flushprint();
+      return (0);
+    }
 
-  if (bind(dd, (struct sockaddr *)sa, sizeof(sa)) < 0)
-  {
-    VPRINT "Bind failed\n");
-    close(dd);
-    flushprint();
-    return (0);
+    VPRINT "Bind to Bluetooth devid user channel\n");
+
+    sa[0] = 31; // hci_family = AF_BLUETOOTH
+    sa[1] = 0;
+    sa[2] = gpar.devid & 0xFF; // hci_dev = hci0/1/2...
+    sa[3] = (gpar.devid >> 8) & 0xFF;
+    sa[4] = 1; // hci_channel = HCI_CHANNEL_USER
+    sa[5] = 0;
+
+    if (bind(dd, (struct sockaddr *)sa, sizeof(sa)) < 0)
+    {
+      VPRINT "Bind failed\n");
+      close(dd);
+      flushprint();
+      return (0);
+    }
   }
 
   gpar.hci = dd;
@@ -8593,6 +8665,27 @@ int hcisock()
   return (1);
 }
 
+/************** HCI TRANSPORT ******
+fd = connected stream or seqpacket socket (e.g. one end of
+     a socketpair) carrying H4 packets (type byte 1/2/4 +
+     HCI packet) to a controller emulator, used instead of
+     the hci user channel socket. Must be called before
+     init_blue. Closed by close_all
+return 0=fail (HCI already open)
+       1=OK
+*************************************/
+
+int hci_transport(int fd)
+{
+  if (gpar.hci > 0)
+  {
+    printf("HCI already open\n");
+    return (0);
+  }
+  gpar.hcitransport = fd;
+  return (1);
+}
+
 /******** OPEN REMOTE SDP *********
 open an L2CAP connection to remote device
 for read SDP database
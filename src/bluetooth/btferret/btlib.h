@@ -103,6 +103,7 @@ int find_channel(int node, int flag, unsigned char *uuid);
 int find_ctics(int node);
 int find_ctic_index(int node, int flag, unsigned char *uuid);
 
+int hci_transport(int fd);
 int hid_key_code(int key);
 
 int init_blue(const char *filename);
@@ -112,7 +113,8 @@ int init_btle(char *name, int hcin);
 int keys_to_callback(int flag, int keyboard);
 
 void le_scan(void);
-int le_server(int (*callback)(int clientnode, int operation, int cticn, void (*onMessage)(unsigned char *data)), int timerds, void (*onMessage)(unsigned char *data));
+int le_server(int (*callback)(int clientnode, int operation, int cticn, void (*onMessage)(unsigned char *data, int count)), int timerds, void (*onMessage)(unsigned char *data, int count));
+int le_write_callback(int (*callback)(int clientnode, int cticn, unsigned char *data, int count, void (*onMessage)(unsigned char *data, int count)));
 
 int list_channels(int node, int flag);
 int list_ctics(int node, int flag);
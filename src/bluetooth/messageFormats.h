@@ -0,0 +1,153 @@
+#ifndef BIKETOURASSISTANT_MESSAGEFORMATS_H
+#define BIKETOURASSISTANT_MESSAGEFORMATS_H
+
+#include "messageLayout.h"
+#include "core/tile.h"
+
+/**
+ * Byte layouts of the messages exchanged with the phone. Messages start with their type byte, all values
+ * are little-endian. Layouts are checked at compile time, MessageReader and MessageWriter refuse fields
+ * that do not fit the message buffer.
+ * */
+namespace message_in {
+  struct SetLightness {
+    typedef MessageField<uint8_t, 1> Lightness;
+  };
+  static_assert(fieldsFit<MESSAGE_IN_MAX_SIZE, SetLightness::Lightness>(1), "SET_LIGHTNESS layout");
+
+  struct LocationUpdate {
+    typedef MessageField<double, 1> Latitude;
+    typedef MessageField<double, 9> Longitude;
+    typedef MessageField<double, 17> Speed;
+    typedef MessageField<double, 25> Heading;
+    typedef MessageField<double, 33> Altitude;
+    typedef MessageField<double, 41> AltitudeAccuracy;
+    typedef MessageField<double, 49> Accuracy;
+    typedef MessageField<uint64_t, 57> Timestamp;
+    typedef MessageField<uint8_t, 65> MapZoom;
+  };
+  static_assert(fieldsFit<MESSAGE_IN_MAX_SIZE, LocationUpdate::Latitude, LocationUpdate::Longitude,
+                          LocationUpdate::Speed, LocationUpdate::Heading, LocationUpdate::Altitude,
+                          LocationUpdate::AltitudeAccuracy, LocationUpdate::Accuracy, LocationUpdate::Timestamp,
+                          LocationUpdate::MapZoom>(1), "LOCATION_UPDATE layout");
+
+  // Compact LOCATION_UPDATE, relative to the previous fix. A full LOCATION_UPDATE is the keyframe that
+  // deltas start from, sent again whenever a delta does not fit its fields.
+  struct LocationUpdateDelta {
+    typedef MessageField<int16_t, 1> LatitudeDelta; // 1e-7 degrees, against the previous fix rounded to 1e-7
+    typedef MessageField<int16_t, 3> LongitudeDelta; // 1e-7 degrees
+    typedef MessageField<uint16_t, 5> Speed; // cm/s
+    typedef MessageField<uint16_t, 7> Heading; // 0.01 degrees
+    typedef MessageField<int16_t, 9> Altitude; // 0.25 m
+    typedef MessageField<uint8_t, 11> AltitudeAccuracy; // 0.5 m
+    typedef MessageField<uint8_t, 12> Accuracy; // 0.5 m
+    typedef MessageField<uint16_t, 13> TimestampDelta; // ms
+    typedef MessageField<uint8_t, 15> MapZoom;
+  };
+  static_assert(fieldsFit<MESSAGE_IN_MAX_SIZE, LocationUpdateDelta::LatitudeDelta, LocationUpdateDelta::LongitudeDelta,
+                          LocationUpdateDelta::Speed, LocationUpdateDelta::Heading, LocationUpdateDelta::Altitude,
+                          LocationUpdateDelta::AltitudeAccuracy, LocationUpdateDelta::Accuracy,
+                          LocationUpdateDelta::TimestampDelta, LocationUpdateDelta::MapZoom>(1),
+                "LOCATION_UPDATE_DELTA layout");
+
+  struct MapTileStart {
+    typedef MessageField<uint32_t, 1> X;
+    typedef MessageField<uint32_t, 5> Y;
+    typedef MessageField<uint8_t, 9> Z;
+    typedef MessageField<uint32_t, 10> DataByteLength;
+    typedef MessageField<uint8_t, 14> Format; // TileFormat, PNG when left out
+  };
+  static_assert(fieldsFit<MESSAGE_IN_MAX_SIZE, MapTileStart::X, MapTileStart::Y, MapTileStart::Z,
+                          MapTileStart::DataByteLength, MapTileStart::Format>(1), "SEND_MAP_TILE_START layout");
+
+  struct MapTileDataChunk {
+    typedef MessageField<uint16_t, 1> ChunkIndex;
+    static constexpr uint32_t dataOffset = 3; // TILE_CHUNK_SIZE bytes of PNG data
+  };
+  static_assert(fieldsFit<MapTileDataChunk::dataOffset, MapTileDataChunk::ChunkIndex>(1) &&
+                MapTileDataChunk::dataOffset + TILE_CHUNK_SIZE <= MESSAGE_IN_MAX_SIZE,
+                "SEND_MAP_TILE_DATA_CHUNK layout");
+
+  // Used by SEND_TOUR_START, SET_DISTANCE_PER_PHOTO and SEND_POINTS_OF_INTEREST_START
+  struct Count16 {
+    typedef MessageField<uint16_t, 1> Count;
+  };
+  static_assert(fieldsFit<MESSAGE_IN_MAX_SIZE, Count16::Count>(1), "16 bit count layout");
+
+  struct TourStartV2 {
+    typedef MessageField<uint32_t, 1> PointsCount;
+  };
+  static_assert(fieldsFit<MESSAGE_IN_MAX_SIZE, TourStartV2::PointsCount>(1), "SEND_TOUR_START_V2 layout");
+
+  struct TourDataChunk {
+    typedef MessageField<uint16_t, 1> ChunkSize;
+    typedef MessageRecords<3, 10> Points;
+    typedef Points::Field<uint16_t, 0> PointIndex;
+    typedef Points::Field<float, 2> Latitude;
+    typedef Points::Field<float, 6> Longitude;
+  };
+  static_assert(fieldsFit<MESSAGE_IN_MAX_SIZE, TourDataChunk::ChunkSize>(1) &&
+                recordFieldsFit<TourDataChunk::Points, TourDataChunk::PointIndex, TourDataChunk::Latitude,
+                                TourDataChunk::Longitude>(TourDataChunk::ChunkSize::end),
+                "SEND_TOUR_DATA_CHUNK layout");
+
+  struct PointsOfInterestDataChunk {
+    typedef MessageField<uint16_t, 1> ChunkSize;
+    typedef MessageRecords<3, 8> Points;
+    typedef Points::Field<float, 0> Latitude;
+    typedef Points::Field<float, 4> Longitude;
+  };
+  static_assert(fieldsFit<MESSAGE_IN_MAX_SIZE, PointsOfInterestDataChunk::ChunkSize>(1) &&
+                recordFieldsFit<PointsOfInterestDataChunk::Points, PointsOfInterestDataChunk::Latitude,
+                                PointsOfInterestDataChunk::Longitude>(PointsOfInterestDataChunk::ChunkSize::end),
+                "SEND_POINTS_OF_INTEREST_DATA_CHUNK layout");
+
+  struct TourDataChunkV2 {
+    typedef MessageField<uint16_t, 1> ChunkSize;
+    typedef MessageRecords<3, 12> Points;
+    typedef Points::Field<uint32_t, 0> PointIndex;
+    typedef Points::Field<float, 4> Latitude;
+    typedef Points::Field<float, 8> Longitude;
+  };
+  static_assert(fieldsFit<MESSAGE_IN_MAX_SIZE, TourDataChunkV2::ChunkSize>(1) &&
+                recordFieldsFit<TourDataChunkV2::Points, TourDataChunkV2::PointIndex, TourDataChunkV2::Latitude,
+                                TourDataChunkV2::Longitude>(TourDataChunkV2::ChunkSize::end),
+                "SEND_TOUR_DATA_CHUNK_V2 layout");
+
+  // Compact tour chunk following SEND_TOUR_START_V2. The first point is absolute, each following one is a pair
+  // of varints relative to the point before it: (zig-zag latitude delta << 1 | segment break), zig-zag longitude
+  // delta. Point indices run on from FirstPointIndex, a segment break skips one so the point starts a new segment.
+  struct TourDataChunkV3 {
+    typedef MessageField<uint16_t, 1> ChunkSize;
+    typedef MessageField<uint32_t, 3> FirstPointIndex;
+    typedef MessageField<int32_t, 7> Latitude; // 1e-5 degrees
+    typedef MessageField<int32_t, 11> Longitude; // 1e-5 degrees
+    static constexpr uint32_t deltasOffset = 15; // Varints up to the end of the message
+  };
+  static_assert(fieldsFit<TourDataChunkV3::deltasOffset, TourDataChunkV3::ChunkSize, TourDataChunkV3::FirstPointIndex,
+                          TourDataChunkV3::Latitude, TourDataChunkV3::Longitude>(1) &&
+                TourDataChunkV3::deltasOffset < MESSAGE_IN_MAX_SIZE,
+                "SEND_TOUR_DATA_CHUNK_V3 layout");
+}
+
+namespace message_out {
+  struct Header {
+    typedef MessageField<uint8_t, 0> Signature0;
+    typedef MessageField<uint8_t, 1> Signature1;
+    typedef MessageField<uint32_t, 2> Index;
+    typedef MessageField<uint8_t, 6> Type;
+    static constexpr uint32_t size = 7; // Real message data starts from 7th byte
+  };
+  static_assert(fieldsFit<Header::size, Header::Signature0, Header::Signature1, Header::Index, Header::Type>(0),
+                "Outbound message header layout");
+
+  struct RequestTile {
+    typedef MessageField<uint32_t, 7> X;
+    typedef MessageField<uint32_t, 11> Y;
+    typedef MessageField<uint32_t, 15> Z;
+  };
+  static_assert(fieldsFit<MESSAGE_OUT_SIZE, RequestTile::X, RequestTile::Y, RequestTile::Z>(Header::size),
+                "MESSAGE_OUT_REQUEST_TILE layout");
+}
+
+#endif //BIKETOURASSISTANT_MESSAGEFORMATS_H
@@ -1,162 +1,319 @@
 #include "messageHandler.h"
+#include "messageFormats.h"
+#include "messageReader.h"
 #include "bluetoothServer.h"
 #include "core/core.h"
+#include "core/tile.h"
 #include "utils.h"
 
 #include <iostream>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
 
 #define MESSAGE_OUT_SIGNATURE_BYTE_0 0x0D
 #define MESSAGE_OUT_SIGNATURE_BYTE_1 0x25
+#define MESSAGE_OUT_QUEUE_CAPACITY 64 // Queue grows past it only if the phone stops confirming messages
+#define MESSAGE_MAX_TILE_BYTE_LENGTH (4 * 1024 * 1024)
+#define MESSAGE_MAX_TOUR_POINTS (1024 * 1024)
+#define MESSAGE_MAX_MAP_ZOOM 22 // Deepest zoom served by web map tile servers
+#define LOCATION_DELTA_DEGREE_SCALE 1e7 // Location deltas are in 1e-7 degrees
+#define TOUR_DELTA_DEGREE_SCALE 1e5 // Compact tour points are in 1e-5 degrees, about a meter
 
+using namespace message_in;
+
+// Last received fix, location deltas apply to it
+struct LocationKeyframe {
+  int32_t latitude; // 1e-7 degrees
+  int32_t longitude;
+  uint64_t timestamp;
+  bool isValid;
+};
 
 struct AwaitingMessage {
-  std::vector<uint8_t> data;
+  MessageOutBuffer data;
   MessagePriority priority;
 };
 
 std::vector<AwaitingMessage> messagesQueue;
-static std::vector<uint8_t> messageOutBuffer(MESSAGE_OUT_SIZE, 0);
+static const MessageOutBuffer emptyMessageOutBuffer = {{0}};
 static uint32_t messageOutIndex = 0;
 static bool waitingForOutMessageConfirmation = false;
+static LocationKeyframe locationKeyframe = {0, 0, 0, false};
 
-void handleMessage(uint8_t *data) {
-  if (!CORE.isBluetoothConnected) {
+static bool isValidCoordinate(double latitude, double longitude) {
+  // Also false for NaN
+  return std::fabs(latitude) <= 90.0 && std::fabs(longitude) <= 180.0;
+}
+
+static int32_t zigZagDecode(uint32_t value) {
+  return int32_t(value >> 1) ^ -int32_t(value & 1);
+}
+
+void handleMessage(uint8_t *data, int length) {
+  if (!CORE.isBluetoothConnected || length <= 0) {
     return;
   }
+  const MessageReader message(data, length);
+  CORE.indexStalledTour();
 
   switch (data[0]) {
-    case 1: // PING
+    case MESSAGE_IN_PING:
       DEBUG("Ping\n");
       if (CORE.isBluetoothConnected) {
         sendMessage(MESSAGE_OUT_PONG);
       }
       break;
-    case 2: { //SET_LIGHTNESS
-      std::cout << "Setting backlight to: " << std::to_string((uint8_t) data[1]) << "%" << std::endl;
-      uint8_t lightness = data[1];
+    case MESSAGE_IN_SET_LIGHTNESS: {
+      uint8_t lightness = message.get<SetLightness::Lightness>();
+      std::cout << "Setting backlight to: " << std::to_string(lightness) << "%" << std::endl;
       CORE.setBacklight(lightness);
     }
       break;
-    case 3: //TAKE_PHOTO
+    case MESSAGE_IN_TAKE_PHOTO:
     {
       CORE.camera.takePhoto();
     }
       break;
-    case 4: // LOCATION_UPDATE
+    case MESSAGE_IN_LOCATION_UPDATE:
     {
-      double latitude = bytesToDouble(data + 1, false);
-      double longitude = bytesToDouble(data + 9, false);
-      double speed = bytesToDouble(data + 17, false);
-      double heading = bytesToDouble(data + 25, false);
-      double altitude = bytesToDouble(data + 33, false);
-      double altitudeAccuracy = bytesToDouble(data + 41, false);
-      double accuracy = bytesToDouble(data + 49, false);
-      uint64_t timestamp = bytesToUint64(data + 57, false);
-      uint8_t mapZoom = data[65];
+      double latitude = message.get<LocationUpdate::Latitude>();
+      double longitude = message.get<LocationUpdate::Longitude>();
+      double speed = message.get<LocationUpdate::Speed>();
+      double heading = message.get<LocationUpdate::Heading>();
+      double altitude = message.get<LocationUpdate::Altitude>();
+      double altitudeAccuracy = message.get<LocationUpdate::AltitudeAccuracy>();
+      double accuracy = message.get<LocationUpdate::Accuracy>();
+      uint64_t timestamp = message.get<LocationUpdate::Timestamp>();
+      uint8_t mapZoom = message.get<LocationUpdate::MapZoom>();
       DEBUG("Location: %f, %f, %f, %f, %f, %f, %llu\n",
             latitude, longitude, speed, heading, altitude, accuracy, timestamp);
+      if (!isValidCoordinate(latitude, longitude) || mapZoom > MESSAGE_MAX_MAP_ZOOM) {
+        std::cerr << "Invalid location: " << latitude << ", " << longitude << " at zoom " << int(mapZoom)
+                  << std::endl;
+        break;
+      }
+      locationKeyframe = {
+          int32_t(std::lround(latitude * LOCATION_DELTA_DEGREE_SCALE)),
+          int32_t(std::lround(longitude * LOCATION_DELTA_DEGREE_SCALE)),
+          timestamp, true
+      };
+      CORE.updateLocation(latitude, longitude, speed, heading, altitude, altitudeAccuracy, accuracy,
+                          timestamp, mapZoom);
+    }
+      break;
+    case MESSAGE_IN_LOCATION_UPDATE_DELTA:
+    {
+      if (!locationKeyframe.isValid) {
+        std::cerr << "Location delta without preceding location update" << std::endl;
+        break;
+      }
+      int32_t latitudeFixed = locationKeyframe.latitude + message.get<LocationUpdateDelta::LatitudeDelta>();
+      int32_t longitudeFixed = locationKeyframe.longitude + message.get<LocationUpdateDelta::LongitudeDelta>();
+      double latitude = latitudeFixed / LOCATION_DELTA_DEGREE_SCALE;
+      double longitude = longitudeFixed / LOCATION_DELTA_DEGREE_SCALE;
+      double speed = message.get<LocationUpdateDelta::Speed>() / 100.0;
+      double heading = message.get<LocationUpdateDelta::Heading>() / 100.0;
+      double altitude = message.get<LocationUpdateDelta::Altitude>() * 0.25;
+      double altitudeAccuracy = message.get<LocationUpdateDelta::AltitudeAccuracy>() * 0.5;
+      double accuracy = message.get<LocationUpdateDelta::Accuracy>() * 0.5;
+      uint64_t timestamp = locationKeyframe.timestamp + message.get<LocationUpdateDelta::TimestampDelta>();
+      uint8_t mapZoom = message.get<LocationUpdateDelta::MapZoom>();
+      DEBUG("Location delta: %f, %f, %f, %f, %f, %f, %llu\n",
+            latitude, longitude, speed, heading, altitude, accuracy, timestamp);
+      if (!isValidCoordinate(latitude, longitude) || mapZoom > MESSAGE_MAX_MAP_ZOOM) {
+        std::cerr << "Invalid location delta: " << latitude << ", " << longitude << " at zoom " << int(mapZoom)
+                  << std::endl;
+        break;
+      }
+      locationKeyframe = {latitudeFixed, longitudeFixed, timestamp, true};
       CORE.updateLocation(latitude, longitude, speed, heading, altitude, altitudeAccuracy, accuracy,
                           timestamp, mapZoom);
     }
       break;
-    case 5: // SEND_MAP_TILE_START
+    case MESSAGE_IN_SEND_MAP_TILE_START:
     {
-      uint32_t x = bytesToUint32(data + 1, false);
-      uint32_t y = bytesToUint32(data + 5, false);
-      uint8_t z = bytesToUint32(data + 9, false);
-      uint32_t dataByteLength = bytesToUint32(data + 10, false);
-      DEBUG("Map tile start: %u, %u, %u, %u\n",
-            x, y, z, dataByteLength);
-      CORE.registerTile(x, y, z, dataByteLength);
+      uint32_t x = message.get<MapTileStart::X>();
+      uint32_t y = message.get<MapTileStart::Y>();
+      uint8_t z = message.get<MapTileStart::Z>();
+      uint32_t dataByteLength = message.get<MapTileStart::DataByteLength>();
+      uint8_t format = message.get<MapTileStart::Format>();
+      DEBUG("Map tile start: %u, %u, %u, %u, format %u\n",
+            x, y, z, dataByteLength, format);
+      if (z > MESSAGE_MAX_MAP_ZOOM || dataByteLength == 0 || dataByteLength > MESSAGE_MAX_TILE_BYTE_LENGTH ||
+          TileDecoder::forFormat(format) == nullptr) {
+        std::cerr << "Invalid map tile " << x << ", " << y << ", " << int(z) << " of " << dataByteLength
+                  << " bytes in format " << int(format) << std::endl;
+        break;
+      }
+      CORE.registerTile(x, y, z, dataByteLength, format);
     }
       break;
-    case 6: // SEND_MAP_TILE_DATA_CHUNK
+    case MESSAGE_IN_SEND_MAP_TILE_DATA_CHUNK:
     {
-      uint16_t chunkIndex = bytesToUint16(data + 1, false);
+      uint16_t chunkIndex = message.get<MapTileDataChunk::ChunkIndex>();
       // DEBUG("Map tile data chunk %d\n", chunkIndex);
-      CORE.appendTileImageData(chunkIndex, data + 3);
+      if (message.length >= MapTileDataChunk::dataOffset + TILE_CHUNK_SIZE) {
+        CORE.appendTileImageData(chunkIndex, data + MapTileDataChunk::dataOffset);
+      } else {
+        // Chunk is read in full, whatever part of it belongs to the tile
+        uint8_t chunk[TILE_CHUNK_SIZE] = {0};
+        if (message.length > MapTileDataChunk::dataOffset) {
+          memcpy(chunk, data + MapTileDataChunk::dataOffset, message.length - MapTileDataChunk::dataOffset);
+        }
+        CORE.appendTileImageData(chunkIndex, chunk);
+      }
     }
       break;
-    case 7: // CLEAR_TOUR_DATA
+    case MESSAGE_IN_CLEAR_TOUR_DATA:
     {
       DEBUG("Clearing tour data\n");
       CORE.tour.clear();
     }
       break;
-    case 8: // SEND_TOUR_START
+    case MESSAGE_IN_SEND_TOUR_START:
     {
-      uint16_t pointsCount = bytesToUint16(data + 1, false);
+      uint16_t pointsCount = message.get<Count16::Count>();
       DEBUG("Receiving tour data with %u points\n", pointsCount);
       CORE.tour.clear(pointsCount);
     }
       break;
-    case 9: // SEND_TOUR_DATA_CHUNK
+    case MESSAGE_IN_SEND_TOUR_DATA_CHUNK:
     {
-      uint16_t chunkSize = bytesToUint16(data + 1, false);
+      uint32_t chunkSize = message.recordCount<TourDataChunk::Points>(message.get<TourDataChunk::ChunkSize>());
       DEBUG("Receiving tour data chunk with %u points\n", chunkSize);
-      for (uint16_t i = 0; i < chunkSize; i++) {
+      for (uint32_t i = 0; i < chunkSize; i++) {
         //NOTE: point index is important for sorting and to mark connections between adjacent points
-        uint16_t pointIndex = bytesToUint16(data + 3 + i * 10, false);
-        float latitude = bytesToFloat(data + 5 + i * 10, false);
-        float longitude = bytesToFloat(data + 9 + i * 10, false);
-        CORE.tour.pushPoint(pointIndex, latitude, longitude);
+        uint16_t pointIndex = message.get<TourDataChunk::PointIndex>(i);
+        float latitude = message.get<TourDataChunk::Latitude>(i);
+        float longitude = message.get<TourDataChunk::Longitude>(i);
+        if (isValidCoordinate(latitude, longitude)) {
+          CORE.tour.pushPoint(pointIndex, latitude, longitude);
+        }
+      }
+      if (CORE.tour.isComplete()) {
+        CORE.needMapRedraw = true;
       }
     }
       break;
-    case 10: // CONFIRM_RECEIVED_MESSAGE
+    case MESSAGE_IN_CONFIRM_RECEIVED_MESSAGE:
     {
       onOutMessageConfirmation();
     }
       break;
-    case 11: // SET_DISTANCE_PER_PHOTO
+    case MESSAGE_IN_SET_DISTANCE_PER_PHOTO:
     {
-      uint16_t distance = bytesToUint16(data + 1, false);
+      uint16_t distance = message.get<Count16::Count>();
       std::cout << "Setting distance per photo: " << std::to_string(distance) << " meters" << std::endl;
       CORE.camera.setDistancePerPhoto(distance);
     }
       break;
-    case 12: // SEND_POINTS_OF_INTEREST_START
+    case MESSAGE_IN_SEND_POINTS_OF_INTEREST_START:
     {
-      uint16_t pointsCount = bytesToUint16(data + 1, false);
+      uint16_t pointsCount = message.get<Count16::Count>();
       DEBUG("Receiving points of interest data with %u points\n", pointsCount);
       CORE.tour.resetPointsOfInterest(pointsCount);
     }
       break;
-    case 13: // SEND_POINTS_OF_INTEREST_DATA_CHUNK
+    case MESSAGE_IN_SEND_POINTS_OF_INTEREST_DATA_CHUNK:
     {
-      uint16_t chunkSize = bytesToUint16(data + 1, false);
+      uint32_t chunkSize = message.recordCount<PointsOfInterestDataChunk::Points>(
+          message.get<PointsOfInterestDataChunk::ChunkSize>());
       DEBUG("Receiving points of interest data chunk with %u points\n", chunkSize);
-      for (uint16_t i = 0; i < chunkSize; i++) {
-        float latitude = bytesToFloat(data + 3 + i * 8, false);
-        float longitude = bytesToFloat(data + 7 + i * 8, false);
-        CORE.tour.pushPointOfInterest(latitude, longitude);
+      for (uint32_t i = 0; i < chunkSize; i++) {
+        float latitude = message.get<PointsOfInterestDataChunk::Latitude>(i);
+        float longitude = message.get<PointsOfInterestDataChunk::Longitude>(i);
+        if (isValidCoordinate(latitude, longitude)) {
+          CORE.tour.pushPointOfInterest(latitude, longitude);
+        }
       }
     } break;
+    case MESSAGE_IN_SEND_TOUR_START_V2:
+    {
+      uint32_t pointsCount = message.get<TourStartV2::PointsCount>();
+      DEBUG("Receiving tour data with %u points\n", pointsCount);
+      if (pointsCount > MESSAGE_MAX_TOUR_POINTS) {
+        std::cerr << "Too many tour points: " << pointsCount << std::endl;
+        break;
+      }
+      CORE.tour.clear(pointsCount);
+    }
+      break;
+    case MESSAGE_IN_SEND_TOUR_DATA_CHUNK_V2:
+    {
+      uint32_t chunkSize = message.recordCount<TourDataChunkV2::Points>(message.get<TourDataChunkV2::ChunkSize>());
+      DEBUG("Receiving tour data chunk with %u points\n", chunkSize);
+      for (uint32_t i = 0; i < chunkSize; i++) {
+        uint32_t pointIndex = message.get<TourDataChunkV2::PointIndex>(i);
+        float latitude = message.get<TourDataChunkV2::Latitude>(i);
+        float longitude = message.get<TourDataChunkV2::Longitude>(i);
+        if (isValidCoordinate(latitude, longitude)) {
+          CORE.tour.pushPoint(pointIndex, latitude, longitude);
+        }
+      }
+      if (CORE.tour.isComplete()) {
+        CORE.needMapRedraw = true;
+      }
+    }
+      break;
+    case MESSAGE_IN_SEND_TOUR_DATA_CHUNK_V3:
+    {
+      uint16_t chunkSize = message.get<TourDataChunkV3::ChunkSize>();
+      uint32_t pointIndex = message.get<TourDataChunkV3::FirstPointIndex>();
+      // Accumulated wider than the fields so that corrupted deltas fail validation instead of wrapping around
+      int64_t latitude = message.get<TourDataChunkV3::Latitude>();
+      int64_t longitude = message.get<TourDataChunkV3::Longitude>();
+      uint32_t offset = TourDataChunkV3::deltasOffset;
+      DEBUG("Receiving compact tour data chunk with %u points\n", chunkSize);
+      for (uint32_t i = 0; i < chunkSize; i++) {
+        if (i > 0) {
+          uint32_t latitudeDelta, longitudeDelta;
+          if (!message.readVarint(offset, latitudeDelta) || !message.readVarint(offset, longitudeDelta)) {
+            std::cerr << "Tour data chunk truncated after " << i << " of " << chunkSize << " points" << std::endl;
+            break;
+          }
+          pointIndex += 1 + (latitudeDelta & 1); // Segment break leaves an index gap
+          latitude += zigZagDecode(latitudeDelta >> 1);
+          longitude += zigZagDecode(longitudeDelta);
+        }
+        double pointLatitude = double(latitude) / TOUR_DELTA_DEGREE_SCALE;
+        double pointLongitude = double(longitude) / TOUR_DELTA_DEGREE_SCALE;
+        if (!isValidCoordinate(pointLatitude, pointLongitude)) {
+          std::cerr << "Invalid tour point " << pointIndex << ": " << pointLatitude << ", " << pointLongitude
+                    << std::endl;
+          break;
+        }
+        CORE.tour.pushPoint(pointIndex, pointLatitude, pointLongitude);
+      }
+      if (CORE.tour.isComplete()) {
+        CORE.needMapRedraw = true;
+      }
+    }
+      break;
     default:
       std::cerr << "Unknown message: " << (uint8_t) data[0] << std::endl;
       break;
   }
 }
 
-void sendMessage(MessageOutType type, std::vector<uint8_t> data, MessagePriority priority = PRIORITY_NORMAL) {
+void sendMessage(MessageOutType type, MessageOutBuffer data, MessagePriority priority = PRIORITY_NORMAL) {
   if (!CORE.isBluetoothConnected) {
     return;
   }
 
-  data[0] = MESSAGE_OUT_SIGNATURE_BYTE_0;
-  data[1] = MESSAGE_OUT_SIGNATURE_BYTE_1;
-
+  MessageWriter<MESSAGE_OUT_SIZE> header(data);
+  header.set<message_out::Header::Signature0>(MESSAGE_OUT_SIGNATURE_BYTE_0);
+  header.set<message_out::Header::Signature1>(MESSAGE_OUT_SIGNATURE_BYTE_1);
   messageOutIndex++;
-  auto *indexBytes = (uint8_t *) &messageOutIndex;
-  data[2] = indexBytes[0];
-  data[3] = indexBytes[1];
-  data[4] = indexBytes[2];
-  data[5] = indexBytes[3];
-  data[6] = (uint8_t) type;
+  header.set<message_out::Header::Index>(messageOutIndex);
+  header.set<message_out::Header::Type>(uint8_t(type));
 
 
   if (waitingForOutMessageConfirmation) {
+    if (messagesQueue.capacity() == 0) {
+      messagesQueue.reserve(MESSAGE_OUT_QUEUE_CAPACITY);
+    }
     messagesQueue.push_back({data, priority});
     return;
   }
@@ -175,7 +332,7 @@ void sendMessage(MessageOutType type, std::vector<uint8_t> data, MessagePriority
 }
 
 void sendMessage(MessageOutType type) {
-  sendMessage(type, messageOutBuffer, PRIORITY_NORMAL);
+  sendMessage(type, emptyMessageOutBuffer, PRIORITY_NORMAL);
 }
 
 void onOutMessageConfirmation() {
@@ -198,9 +355,10 @@ void onOutMessageConfirmation() {
 }
 
 void resetOutMessagesQueue() {
-  for (auto &message: messagesQueue) {
-    message.data.clear();
-  }
   messagesQueue.clear();
   waitingForOutMessageConfirmation = false;
+}
+
+void resetLocationKeyframe() {
+  locationKeyframe.isValid = false;
 }
\ No newline at end of file
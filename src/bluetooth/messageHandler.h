@@ -1,10 +1,12 @@
 #ifndef BIKETOURASSISTANT_MESSAGEHANDLER_H
 #define BIKETOURASSISTANT_MESSAGEHANDLER_H
 
-#include <vector>
+#include "messageLayout.h"
+
+#include <array>
 #include <cstdint>
 
-#define MESSAGE_OUT_SIZE 64
+typedef std::array<uint8_t, MESSAGE_OUT_SIZE> MessageOutBuffer;
 
 enum MessagePriority {
   PRIORITY_VERY_HIGH = 1,
@@ -14,16 +16,38 @@ enum MessagePriority {
   PRIORITY_VERY_LOW
 };
 
+enum MessageInType {
+  MESSAGE_IN_PING = 1,
+  MESSAGE_IN_SET_LIGHTNESS,
+  MESSAGE_IN_TAKE_PHOTO,
+  MESSAGE_IN_LOCATION_UPDATE,
+  MESSAGE_IN_SEND_MAP_TILE_START,
+  MESSAGE_IN_SEND_MAP_TILE_DATA_CHUNK,
+  MESSAGE_IN_CLEAR_TOUR_DATA,
+  MESSAGE_IN_SEND_TOUR_START,
+  MESSAGE_IN_SEND_TOUR_DATA_CHUNK,
+  MESSAGE_IN_CONFIRM_RECEIVED_MESSAGE,
+  MESSAGE_IN_SET_DISTANCE_PER_PHOTO,
+  MESSAGE_IN_SEND_POINTS_OF_INTEREST_START,
+  MESSAGE_IN_SEND_POINTS_OF_INTEREST_DATA_CHUNK,
+  MESSAGE_IN_SEND_TOUR_START_V2,
+  MESSAGE_IN_SEND_TOUR_DATA_CHUNK_V2,
+  MESSAGE_IN_LOCATION_UPDATE_DELTA,
+  MESSAGE_IN_SEND_TOUR_DATA_CHUNK_V3,
+};
+
 enum MessageOutType {
   MESSAGE_OUT_PONG = 1,
   MESSAGE_OUT_REQUEST_TILE,
 };
 
-void handleMessage(uint8_t *data);
+void handleMessage(uint8_t *data, int length); // data points to the received characteristic value of length bytes
 
-void sendMessage(MessageOutType type, std::vector<uint8_t> data, MessagePriority priority); // Real message data starts from 7th byte
+// Message fields start after message_out::Header, see messageFormats.h
+void sendMessage(MessageOutType type, MessageOutBuffer data, MessagePriority priority);
 void sendMessage(MessageOutType type);
 void onOutMessageConfirmation();
 void resetOutMessagesQueue();
+void resetLocationKeyframe(); // Location deltas are dropped until the next full location update
 
 #endif //BIKETOURASSISTANT_MESSAGEHANDLER_H
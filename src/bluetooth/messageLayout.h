@@ -0,0 +1,130 @@
+#ifndef BIKETOURASSISTANT_MESSAGELAYOUT_H
+#define BIKETOURASSISTANT_MESSAGELAYOUT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#define MESSAGE_IN_MAX_SIZE 244 // Largest characteristic value btlib passes to le_value_callback
+#define MESSAGE_OUT_SIZE 64
+
+namespace message_layout_detail {
+  template<size_t Size>
+  struct UnsignedOfSize;
+
+  template<>
+  struct UnsignedOfSize<1> {
+    typedef uint8_t type;
+    static uint8_t swap(uint8_t value) { return value; }
+  };
+
+  template<>
+  struct UnsignedOfSize<2> {
+    typedef uint16_t type;
+    static uint16_t swap(uint16_t value) { return __builtin_bswap16(value); }
+  };
+
+  template<>
+  struct UnsignedOfSize<4> {
+    typedef uint32_t type;
+    static uint32_t swap(uint32_t value) { return __builtin_bswap32(value); }
+  };
+
+  template<>
+  struct UnsignedOfSize<8> {
+    typedef uint64_t type;
+    static uint64_t swap(uint64_t value) { return __builtin_bswap64(value); }
+  };
+
+  // Converts between host and little-endian (message) byte order
+  template<typename Bits>
+  Bits littleEndian(Bits bits) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return UnsignedOfSize<sizeof(Bits)>::swap(bits);
+#else
+    return bits;
+#endif
+  }
+}
+
+/** Field of type T stored little-endian at byte Offset of a message */
+template<typename T, uint32_t Offset>
+struct MessageField {
+  typedef T Type;
+  static constexpr uint32_t offset = Offset;
+  static constexpr uint32_t end = Offset + sizeof(T);
+  static constexpr uint32_t stride = 0;
+};
+
+/** List of records of Stride bytes, filling a message from byte Offset up to the number of records it holds */
+template<uint32_t Offset, uint32_t Stride>
+struct MessageRecords {
+  static constexpr uint32_t offset = Offset;
+  static constexpr uint32_t stride = Stride;
+  static constexpr uint32_t maxCount = (MESSAGE_IN_MAX_SIZE - Offset) / Stride;
+
+  /** Field of type T at byte FieldOffset of each record, offsets are of the first record */
+  template<typename T, uint32_t FieldOffset>
+  struct Field {
+    typedef T Type;
+    static constexpr uint32_t offset = Offset + FieldOffset;
+    static constexpr uint32_t end = Offset + FieldOffset + sizeof(T);
+    static constexpr uint32_t stride = Stride;
+  };
+};
+
+// Compile-time check for layouts: fields are listed in order, starting at or after given offset,
+// do not overlap and end within Size bytes
+template<uint32_t Size>
+constexpr bool fieldsFit(uint32_t previousEnd) {
+  return previousEnd <= Size;
+}
+
+template<uint32_t Size, typename Field, typename... Fields>
+constexpr bool fieldsFit(uint32_t previousEnd) {
+  return previousEnd <= Field::offset && fieldsFit<Size, Fields...>(Field::end);
+}
+
+// Record fields follow each other within the first record and records start after the fixed fields
+template<typename Records, typename... Fields>
+constexpr bool recordFieldsFit(uint32_t fixedFieldsEnd) {
+  return fixedFieldsEnd <= Records::offset && Records::maxCount > 0 &&
+         fieldsFit<Records::offset + Records::stride, Fields...>(Records::offset);
+}
+
+/** Encodes fields of a layout into a fixed size message buffer, fields must fit the buffer at compile time */
+template<size_t Size>
+class MessageWriter {
+public:
+  explicit MessageWriter(std::array<uint8_t, Size> &buffer) : buffer(buffer) {}
+
+  template<typename Field>
+  void set(typename Field::Type value) {
+    static_assert(Field::end <= Size, "Message field exceeds message buffer");
+    this->write(Field::offset, value);
+  }
+
+  // Writes a field of the index-th record, records past the end of the buffer are left out
+  template<typename Field>
+  void set(uint32_t index, typename Field::Type value) {
+    const uint32_t offset = Field::offset + index * Field::stride;
+    if (offset + sizeof(value) <= Size) {
+      this->write(offset, value);
+    }
+  }
+
+private:
+  std::array<uint8_t, Size> &buffer;
+
+  template<typename T>
+  void write(uint32_t offset, T value) {
+    typedef message_layout_detail::UnsignedOfSize<sizeof(T)> Bits;
+    typename Bits::type bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits = message_layout_detail::littleEndian(bits);
+    memcpy(&this->buffer[offset], &bits, sizeof(bits));
+  }
+};
+
+#endif //BIKETOURASSISTANT_MESSAGELAYOUT_H
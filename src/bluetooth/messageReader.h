@@ -0,0 +1,74 @@
+#ifndef BIKETOURASSISTANT_MESSAGEREADER_H
+#define BIKETOURASSISTANT_MESSAGEREADER_H
+
+#include "messageLayout.h"
+
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Reads little-endian fields of a received message at byte offsets. Each read is a memcpy of the field,
+ * which compiles to a single unaligned load (plus a byte swap on big-endian hosts).
+ * Bytes past the end of the message read as zeros, as from the zero-filled characteristic buffer.
+ * */
+class MessageReader {
+public:
+  MessageReader(const uint8_t *data, int length) : data(data), length(length > 0 ? uint32_t(length) : 0) {}
+
+  template<typename T>
+  T read(uint32_t offset) const {
+    typedef message_layout_detail::UnsignedOfSize<sizeof(T)> Bits;
+    typename Bits::type bits = 0;
+    if (offset + sizeof(T) <= this->length) {
+      memcpy(&bits, this->data + offset, sizeof(T));
+    } else if (offset < this->length) {
+      memcpy(&bits, this->data + offset, this->length - offset);
+    }
+    bits = message_layout_detail::littleEndian(bits);
+    T value;
+    memcpy(&value, &bits, sizeof(T));
+    return value;
+  }
+
+  // Reads a field of a message layout (see messageFormats.h)
+  template<typename Field>
+  typename Field::Type get() const {
+    static_assert(Field::end <= MESSAGE_IN_MAX_SIZE, "Message field exceeds characteristic size");
+    return this->read<typename Field::Type>(Field::offset);
+  }
+
+  // Reads a field of the index-th record of a message layout
+  template<typename Field>
+  typename Field::Type get(uint32_t index) const {
+    return this->read<typename Field::Type>(Field::offset + index * Field::stride);
+  }
+
+  // Number of complete records in the message, at most given count announced by the message itself
+  template<typename Records>
+  uint32_t recordCount(uint32_t announcedCount) const {
+    uint32_t received = this->length > Records::offset ? (this->length - Records::offset) / Records::stride : 0;
+    return announcedCount < received ? announcedCount : received;
+  }
+
+  // Reads an unsigned LEB128 varint at offset and moves offset past it. False when the varint is cut off by
+  // the end of the message or does not fit 32 bits.
+  bool readVarint(uint32_t &offset, uint32_t &value) const {
+    value = 0;
+    for (uint32_t shift = 0; shift < 32; shift += 7) {
+      if (offset >= this->length) {
+        return false;
+      }
+      const uint8_t byte = this->data[offset++];
+      value |= uint32_t(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const uint8_t *const data;
+  const uint32_t length;
+};
+
+#endif //BIKETOURASSISTANT_MESSAGEREADER_H
@@ -0,0 +1,177 @@
+#include "messageTrace.h"
+#include "Debug.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+#define MESSAGE_TRACE_HEADER_SIZE 16
+#define MESSAGE_TRACE_BUFFER_SIZE (64 * 1024)
+
+static const char messageTraceMagic[4] = {'B', 'T', 'A', 'T'};
+
+static std::mutex traceMutex;
+static FILE *traceFile = nullptr;
+static std::chrono::steady_clock::time_point traceStartTime;
+static uint64_t lastRecordTimestamp = 0;
+
+static void writeLittleEndian(uint8_t *bytes, uint64_t value, uint8_t size) {
+  for (uint8_t i = 0; i < size; i++) {
+    bytes[i] = uint8_t(value >> (8 * i));
+  }
+}
+
+// Unsigned LEB128, returns number of bytes written (at most 10)
+static uint8_t writeVarint(uint8_t *bytes, uint64_t value) {
+  uint8_t count = 0;
+  do {
+    bytes[count] = uint8_t(value & 0x7F);
+    value >>= 7;
+    if (value != 0) {
+      bytes[count] |= 0x80;
+    }
+    count++;
+  } while (value != 0);
+  return count;
+}
+
+bool startMessageTrace(const std::string &path) {
+  std::lock_guard<std::mutex> lock(traceMutex);
+  if (traceFile != nullptr) {
+    fclose(traceFile);
+  }
+
+  traceFile = fopen(path.c_str(), "wb");
+  if (traceFile == nullptr) {
+    std::cerr << "Cannot create message trace " << path << std::endl;
+    return false;
+  }
+  // Records are small, so they are written in large blocks
+  setvbuf(traceFile, nullptr, _IOFBF, MESSAGE_TRACE_BUFFER_SIZE);
+
+  const auto wallClockTime = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()
+  ).count();
+  uint8_t header[MESSAGE_TRACE_HEADER_SIZE] = {0};
+  memcpy(header, messageTraceMagic, sizeof(messageTraceMagic));
+  header[4] = MESSAGE_TRACE_VERSION;
+  writeLittleEndian(header + 8, uint64_t(wallClockTime), 8);
+  fwrite(header, 1, sizeof(header), traceFile);
+
+  traceStartTime = std::chrono::steady_clock::now();
+  lastRecordTimestamp = 0;
+  DEBUG("Recording message trace to %s\n", path.c_str());
+  return true;
+}
+
+void stopMessageTrace() {
+  std::lock_guard<std::mutex> lock(traceMutex);
+  if (traceFile != nullptr) {
+    fclose(traceFile);
+    traceFile = nullptr;
+  }
+}
+
+void traceMessage(TraceRecordType type, const uint8_t *data, uint16_t length) {
+  std::lock_guard<std::mutex> lock(traceMutex);
+  if (traceFile == nullptr) {
+    return;
+  }
+
+  const auto timestamp = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - traceStartTime
+  ).count());
+
+  uint8_t recordHeader[1 + 10 + 10];
+  uint8_t size = 0;
+  recordHeader[size++] = uint8_t(type);
+  size += writeVarint(recordHeader + size, timestamp - lastRecordTimestamp);
+  size += writeVarint(recordHeader + size, length);
+  fwrite(recordHeader, 1, size, traceFile);
+  if (length > 0) {
+    fwrite(data, 1, length, traceFile);
+  }
+  lastRecordTimestamp = timestamp;
+
+  // Disconnection ends a ride segment, keep it on disk even if the device is switched off afterwards
+  if (type == TRACE_RECORD_DISCONNECT) {
+    fflush(traceFile);
+  }
+}
+
+MessageTraceReader::MessageTraceReader() : file(nullptr), startTime(0), lastTimestamp(0) {
+  // noop
+}
+
+MessageTraceReader::~MessageTraceReader() {
+  if (this->file != nullptr) {
+    fclose(this->file);
+  }
+}
+
+bool MessageTraceReader::open(const std::string &path) {
+  if (this->file != nullptr) {
+    fclose(this->file);
+  }
+  this->file = fopen(path.c_str(), "rb");
+  if (this->file == nullptr) {
+    return false;
+  }
+
+  uint8_t header[MESSAGE_TRACE_HEADER_SIZE];
+  if (fread(header, 1, sizeof(header), this->file) != sizeof(header) ||
+      memcmp(header, messageTraceMagic, sizeof(messageTraceMagic)) != 0 ||
+      header[4] != MESSAGE_TRACE_VERSION) {
+    fclose(this->file);
+    this->file = nullptr;
+    return false;
+  }
+
+  this->startTime = 0;
+  for (uint8_t i = 0; i < 8; i++) {
+    this->startTime |= uint64_t(header[8 + i]) << (8 * i);
+  }
+  this->lastTimestamp = 0;
+  return true;
+}
+
+bool MessageTraceReader::readVarint(uint64_t &value) {
+  value = 0;
+  for (uint8_t shift = 0; shift < 64; shift += 7) {
+    const int byte = fgetc(this->file);
+    if (byte == EOF) {
+      return false;
+    }
+    value |= uint64_t(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MessageTraceReader::next(TraceRecord &record) {
+  if (this->file == nullptr) {
+    return false;
+  }
+
+  const int type = fgetc(this->file);
+  uint64_t delta, length;
+  if (type == EOF || !this->readVarint(delta) || !this->readVarint(length) || length > UINT16_MAX) {
+    return false;
+  }
+
+  record.type = TraceRecordType(type);
+  record.timestamp = this->lastTimestamp + delta;
+  record.data.resize(size_t(length));
+  if (length > 0 && fread(record.data.data(), 1, size_t(length), this->file) != length) {
+    return false;
+  }
+  this->lastTimestamp = record.timestamp;
+  return true;
+}
+
+uint64_t MessageTraceReader::getStartTime() const {
+  return this->startTime;
+}
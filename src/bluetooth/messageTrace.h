@@ -0,0 +1,62 @@
+#ifndef BIKETOURASSISTANT_MESSAGETRACE_H
+#define BIKETOURASSISTANT_MESSAGETRACE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * Binary trace of bluetooth traffic, used to replay rides without the phone (see bench/trace_replay.cpp).
+ *
+ * File starts with "BTAT", format version byte, three zero bytes and the recording start as 64-bit little-endian
+ * microseconds since the Unix epoch. Each record follows as: type byte, microseconds since the previous record
+ * and payload length (both unsigned LEB128 varints), payload.
+ * */
+#define MESSAGE_TRACE_VERSION 1
+
+enum TraceRecordType {
+  TRACE_RECORD_INBOUND = 1, // Characteristic write received from the phone, as passed to handleMessage
+  TRACE_RECORD_OUTBOUND, // Message sent to the phone
+  TRACE_RECORD_CONNECT,
+  TRACE_RECORD_DISCONNECT,
+};
+
+struct TraceRecord {
+  TraceRecordType type;
+  uint64_t timestamp; // microseconds since the recording start
+  std::vector<uint8_t> data;
+};
+
+// Starts recording bluetooth traffic into given file, replacing it. Returns false if the file cannot be created.
+bool startMessageTrace(const std::string &path);
+
+void stopMessageTrace();
+
+// Appends a record if recording is on, safe to call from any thread
+void traceMessage(TraceRecordType type, const uint8_t *data, uint16_t length);
+
+class MessageTraceReader {
+public:
+  MessageTraceReader();
+
+  ~MessageTraceReader();
+
+  // Returns false if the file cannot be read or is not a trace
+  bool open(const std::string &path);
+
+  // Reads the next record, returns false at the end of the trace or on a truncated record
+  bool next(TraceRecord &record);
+
+  // Recording start in microseconds since the Unix epoch
+  uint64_t getStartTime() const;
+
+private:
+  bool readVarint(uint64_t &value);
+
+  FILE *file;
+  uint64_t startTime;
+  uint64_t lastTimestamp;
+};
+
+#endif //BIKETOURASSISTANT_MESSAGETRACE_H
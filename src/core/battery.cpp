@@ -30,6 +30,10 @@ void Battery::update() {
   try {
     std::string batteryCommand = std::string("python3 ") + pwd() + "/../measure_battery.py";
     char *battery_output = executeCommand(batteryCommand.c_str());
+    if (battery_output == nullptr) {
+      // Measurement is retried after the next interval
+      return;
+    }
 
     auto percentageValue = uint8_t(atoi(battery_output));
     if (percentageValue != this->percentage) {
@@ -39,6 +43,9 @@ void Battery::update() {
     free(battery_output);
 
     char *temperature_output = executeCommand("vcgencmd measure_temp"); //example temperature_output: temp=45.6'C
+    if (temperature_output == nullptr) {
+      return;
+    }
     this->temperature = uint16_t(atof(temperature_output + 5));
     DEBUG("Device temperature: %u Celsius; Battery percentage: %u%%\n", this->temperature, this->percentage);
     free(temperature_output);
@@ -32,13 +32,26 @@ struct Location {
   uint64_t previousUpdateTimestamp;
 };
 
+// Pre-rendered RGB565 image in panel layout (see drawImageBuffer)
+struct Sprite {
+  uint16_t width;
+  uint16_t height;
+  std::vector<uint16_t> pixels;
+};
+
 struct Icons {
   std::vector<uint8_t> directionArrowImageData;
   std::pair<uint16_t, uint16_t> directionArrowSize;
+  // Arrow blended over the background for every rotation step, in panel layout (see renderer::prepareDirectionArrowSprites)
+  std::vector<uint16_t> directionArrowSprites;
   std::vector<uint8_t> slopeUphillImageData;
   std::vector<uint8_t> slopeDownhillImageData;
   std::pair<uint16_t, uint16_t> slopeIconSize;
   std::vector<std::vector<uint8_t>> digits40x80ImageData;
+  // Speed digits blended over the background in full and reduced size (see renderer::prepareDigitSprites)
+  std::vector<Sprite> digitSprites;
+  std::vector<Sprite> smallDigitSprites;
+  Sprite decimalPointSprite;
 };
 
 double calculateSlope(const std::vector<Location> &locationHistory);
@@ -2,6 +2,7 @@
 #include "utils.h"
 #include "renderer.h"
 #include "pngUtils.h"
+#include "bluetooth/messageFormats.h"
 #include "bluetooth/messageHandler.h"
 
 #include <cmath>
@@ -25,6 +26,9 @@ Core::Core() : isBluetoothConnected(false), isRunning(false), isInactive(false),
 Core::~Core() {
   this->clearTiles();
   this->icons.directionArrowImageData.clear();
+  this->icons.directionArrowSprites.clear();
+  this->icons.digitSprites.clear();
+  this->icons.smallDigitSprites.clear();
   this->icons.slopeUphillImageData.clear();
   this->icons.slopeDownhillImageData.clear();
   this->locationHistory.clear();
@@ -35,6 +39,7 @@ void Core::start() {
       this->icons.directionArrowImageData,
       pwd() + "/../assets/direction_arrow_40x40.png", LCT_RGBA
   );
+  renderer::prepareDirectionArrowSprites(this->icons);
   this->icons.slopeIconSize = loadPngFile(
       this->icons.slopeUphillImageData,
       pwd() + "/../assets/slope_uphill.png", LCT_RGBA
@@ -51,6 +56,7 @@ void Core::start() {
         digitFilePath, LCT_GREY_ALPHA
     );
   }
+  renderer::prepareDigitSprites(this->icons);
 
   this->isRunning = true;
 }
@@ -63,6 +69,7 @@ void Core::reset() {
   this->needDirectionRedraw = true;
   this->needSlopeRedraw = true;
   this->battery.needRedraw = true;
+  this->viewAnimator.reset();
   this->registerActivity();
 }
 
@@ -83,6 +90,14 @@ void Core::update() {
       LCD_SetBacklight(0);
     }
   }
+
+  uint8_t viewChanges = this->viewAnimator.update(std::chrono::steady_clock::now());
+  if (viewChanges != VIEW_CHANGED_NONE) {
+    this->needMapRedraw = true;
+  }
+  if (viewChanges & VIEW_CHANGED_HEADING) {
+    this->needDirectionRedraw = true;
+  }
 }
 
 void Core::registerActivity() {
@@ -99,16 +114,19 @@ void Core::setBacklight(uint8_t lightness) {
 }
 
 void Core::clearTiles() {
+  std::lock_guard<std::mutex> lock(this->tilesMutex);
   for (const auto &tile: this->tiles) {
     delete tile.second;
   }
   this->tiles.clear();
   this->requestedTiles.clear();
+  delete this->fetchingTile;
   this->fetchingTile = nullptr;
+  renderer::invalidateMapCache();
 }
 
 void
-Core::registerTile(uint32_t x, uint32_t y, uint8_t z, uint32_t dataByteLength) {
+Core::registerTile(uint32_t x, uint32_t y, uint8_t z, uint32_t dataByteLength, uint8_t format) {
   if (z != this->mapZoom) {
     // Discard loaded tiles if zoom level has changed
     this->clearTiles();
@@ -116,9 +134,9 @@ Core::registerTile(uint32_t x, uint32_t y, uint8_t z, uint32_t dataByteLength) {
     this->tour.setZoom(z);
   }
 
-  Tile *tile = new Tile(x, y, z, dataByteLength);
-  this->tiles[Tile::getTileKey(x, y, z)] = tile;
-  this->fetchingTile = tile;
+  // Tile left unfinished by the previous transfer is dropped
+  delete this->fetchingTile;
+  this->fetchingTile = new Tile(x, y, z, dataByteLength, format);
 }
 
 void Core::appendTileImageData(uint16_t chunkIndex, uint8_t *data) {
@@ -127,13 +145,37 @@ void Core::appendTileImageData(uint16_t chunkIndex, uint8_t *data) {
     return;
   }
 
-  this->fetchingTile->appendPngData(chunkIndex, data);
+  this->fetchingTile->appendData(chunkIndex, data);
+  if (!this->fetchingTile->isFullyLoaded()) {
+    return;
+  }
 
-  if (this->fetchingTile->isFullyLoaded()) {
-    std::cout << "Tile " << this->fetchingTile->key << " is fully loaded" << std::endl;
-    this->fetchingTile = nullptr;
+  std::cout << "Tile " << this->fetchingTile->key << " is fully loaded" << std::endl;
+  // Decoded without the lock, the display thread only waits for the decoded tile to be swapped in
+  Tile *tile = this->fetchingTile->decode();
+  delete this->fetchingTile;
+  this->fetchingTile = nullptr;
+  if (tile == nullptr) {
+    return;
+  }
+
+  Tile *replacedTile;
+  {
+    std::lock_guard<std::mutex> lock(this->tilesMutex);
+    Tile *&registeredTile = this->tiles[tile->key];
+    // Tile sent again replaces the previous one
+    replacedTile = registeredTile;
+    registeredTile = tile;
+    renderer::invalidateMapCache();
+  }
+  delete replacedTile;
+  this->needMapRedraw = true;
+  this->registerActivity();
+}
+
+void Core::indexStalledTour() {
+  if (this->tour.indexStalledPoints()) {
     this->needMapRedraw = true;
-    this->registerActivity();
   }
 }
 
@@ -156,10 +198,9 @@ void Core::updateLocation(
     this->registerActivity();
   }
 
+  // Map and direction arrow follow the location through the view animator
   if (std::round(this->location.heading) != std::round(heading)) {
     this->location.heading = heading;
-    this->needMapRedraw = true;
-    this->needDirectionRedraw = true;
     this->registerActivity();
   }
 
@@ -172,7 +213,6 @@ void Core::updateLocation(
   if (positionDifference > 0.5) {
     this->location.latitude = latitude;
     this->location.longitude = longitude;
-    this->needMapRedraw = true;
     this->registerActivity();
     this->camera.updateLocation(latitude, longitude);
   }
@@ -186,6 +226,8 @@ void Core::updateLocation(
   this->location.timestamp = timestamp;
   this->location.previousUpdateTimestamp = previousUpdateTimestamp;
 
+  this->viewAnimator.setTarget(latitude, longitude, heading, locationMapZoom);
+
   this->locationHistory.push_back(this->location);
   while (this->locationHistory.size() > LOCATION_HISTORY_SIZE) {
     this->locationHistory.erase(this->locationHistory.begin());
@@ -222,27 +264,71 @@ void Core::requestTileData(uint32_t x, uint32_t y, uint8_t z) {
   Tile *cachedTile = Tile::loadFromCache(x, y, z);
   if (cachedTile != nullptr) {
     DEBUG("Tile %s loaded from cache\n", cachedTile->key.c_str());
-    this->tiles[tileKey] = cachedTile;
+    {
+      std::lock_guard<std::mutex> lock(this->tilesMutex);
+      this->tiles[tileKey] = cachedTile;
+    }
+    renderer::invalidateMapCache();
     this->needMapRedraw = true;
     this->registerActivity();
     return;
   }
 
-  std::vector<uint8_t> tileData(MESSAGE_OUT_SIZE);
-  uint32ToBytes(x, &tileData[0] + 7, false);
-  uint32ToBytes(y, &tileData[0] + 11, false);
-  uint32ToBytes(z, &tileData[0] + 15, false);
+  MessageOutBuffer tileData = {{0}};
+  MessageWriter<MESSAGE_OUT_SIZE> request(tileData);
+  request.set<message_out::RequestTile::X>(x);
+  request.set<message_out::RequestTile::Y>(y);
+  request.set<message_out::RequestTile::Z>(z);
   sendMessage(MESSAGE_OUT_REQUEST_TILE, tileData, PRIORITY_NORMAL);
 }
 
 void Core::drawMap() {
+  std::lock_guard<std::mutex> lock(this->tilesMutex);
   try {
-    renderer::renderMap(this->tiles, this->tour, this->location, this->mapZoom);
+    renderer::renderMap(this->tiles, this->tour, this->getViewLocation(), this->mapZoom);
   } catch (const std::exception &e) {
     std::cerr << "Error rendering map: " << e.what() << std::endl;
   }
 }
 
+void Core::redraw() {
+  if (this->needMapRedraw) {
+    this->needMapRedraw = false;
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    this->drawMap();
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto executionDuration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+    DEBUG("Map render took %lld milliseconds\n", executionDuration.count());
+  }
+
+  if (this->needSpeedRedraw) {
+    this->needSpeedRedraw = false;
+    renderer::drawSpeed(this->location.speed, this->icons);
+  }
+
+  if (this->needDirectionRedraw) {
+    this->needDirectionRedraw = false;
+    renderer::drawDirectionArrow(this->getViewLocation().heading, this->icons);
+  }
+
+  if (this->needSlopeRedraw) {
+    this->needSlopeRedraw = false;
+    renderer::drawSlope(this->getSlope(), this->location.altitude, this->icons);
+  }
+
+  if (this->battery.needRedraw) {
+    this->battery.needRedraw = false;
+    renderer::drawBattery(this->battery.getPercentage(), this->battery.isOverheated());
+  }
+}
+
+Location Core::getViewLocation() const {
+  return this->viewAnimator.apply(this->location);
+}
+
 double Core::getSlope() const {
   return calculateSlope(this->locationHistory);
 }
@@ -6,10 +6,12 @@
 #include "battery.h"
 #include "camera.h"
 #include "common.h"
+#include "viewAnimator.h"
 
 #include <cstdint>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <set>
 #include <chrono>
 
@@ -53,16 +55,25 @@ public:
 
   void setBacklight(uint8_t lightness);
 
-  void registerTile(uint32_t x, uint32_t y, uint8_t z, uint32_t dataByteLength);
+  void registerTile(uint32_t x, uint32_t y, uint8_t z, uint32_t dataByteLength, uint8_t format);
 
   void appendTileImageData(uint16_t chunkIndex, uint8_t *data);
 
+  // Draws a tour which stopped arriving before it completed, called by the bluetooth thread
+  void indexStalledTour();
+
   void updateLocation(double latitude, double longitude,
                       double speed, double heading,
                       double altitude, double altitudeAccuracy, double accuracy, uint64_t timestamp, uint8_t mapZoom);
 
   void drawMap();
 
+  // Draws parts of the main view flagged as changed
+  void redraw();
+
+  // Location with the heading and position currently shown on the map
+  Location getViewLocation() const;
+
   double getSlope() const;
 
   const Icons &getIcons() const;
@@ -78,13 +89,16 @@ private:
   bool isInactive;
   uint8_t backlightLightness; // 0-100
 
+  // Tiles are added and deleted by the bluetooth thread while the display thread renders them
+  std::mutex tilesMutex;
   std::map<std::string, Tile *> tiles;
   std::set<std::string> requestedTiles;
-  Tile *fetchingTile;
+  Tile *fetchingTile; // Received by the bluetooth thread, added to tiles once decoded
   uint8_t mapZoom;
 
   Icons icons;
   std::vector <Location> locationHistory;
+  ViewAnimator viewAnimator;
 };
 
 extern Core &CORE;
@@ -1,8 +1,16 @@
 #include "renderer.h"
+#include "display/canvas.h"
 #include "display/draw.h"
+#include "display/glyph_atlas.h"
+#include "display/polyline.h"
 #include "utils.h"
+#include "workerPool.h"
 
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <cstring>
+#include <memory>
 
 extern "C"
 {
@@ -14,6 +22,44 @@ extern "C"
 #define BACKGROUND_BLUE 52
 static auto backgroundColor = RGB(BACKGROUND_RED, BACKGROUND_GREEN, BACKGROUND_BLUE);
 
+// Widget texts are drawn from fonts pre-expanded for their colors
+static GlyphAtlas slopeUphillTextAtlas(&Font16, RGB(255, 235, 238), backgroundColor);
+static GlyphAtlas slopeDownhillTextAtlas(&Font16, RGB(232, 245, 233), backgroundColor);
+static GlyphAtlas batteryErrorTextAtlas(&Font16, RGB(229, 115, 115), backgroundColor);
+static GlyphAtlas batteryTextAtlas; // Battery color follows the percentage, re-expanded when it changes
+
+// Texts shown by the widgets, which are not redrawn until their text changes. Cleared with the screen.
+static std::string drawnBatteryText;
+static std::string drawnSlopeText;
+static std::string drawnSpeedText;
+static uint16_t drawnDirectionArrowStep = DIRECTION_ARROW_STEPS; // None
+
+static PolylineRasterizer tourLineRasterizer(MAP_WIDTH, MAP_HEIGHT);
+
+// Tiles around the location taken into account when filling the map, enough for any heading
+#define MAP_VIEW_TILES 3
+#define MAP_VIEW_FIXED_POINT_BITS 16
+// Bilinear sampling costs 2-3x nearest in render_bench, it is not the default until it fits the frame budget on the Pi
+static MapSamplingMode mapSamplingMode = SAMPLING_NEAREST;
+
+static MapRenderTimes lastMapRenderTimes = {0.0, 0.0};
+
+static std::unique_ptr<WorkerPool> mapRenderWorkers(new WorkerPool(MAP_RENDER_WORKERS));
+static uint16_t mapRenderBands = MAP_RENDER_BANDS;
+
+// Map rendered with overscan on each side, so frames which only move the location are cut out of it
+#define MAP_OVERSCAN 32
+#define MAP_CACHE_WIDTH (MAP_WIDTH + 2 * MAP_OVERSCAN)
+#define MAP_CACHE_HEIGHT (MAP_HEIGHT + 2 * MAP_OVERSCAN)
+
+#define SPEED_SHOW_TENTHS 0 // Show speed below 100 km/h with tenths
+#define DIGIT_WIDTH 40
+#define DIGIT_HEIGHT 80
+// Reduced digits fit three digits and a decimal point into the speed widget
+#define SMALL_DIGIT_WIDTH 24
+#define SMALL_DIGIT_HEIGHT 48
+#define DECIMAL_POINT_WIDTH 8
+
 void rotateAroundPivot(double x, double y, double pivotX, double pivotY, double rotation, double &outX, double &outY) {
   if (rotation == 0) {
     outX = x;
@@ -32,10 +78,65 @@ void rotateAroundPivot(double x, double y, double pivotX, double pivotY, double
   outY = pyRot + pivotY;
 }
 
+/**
+ * Liang-Barsky clipping of a line segment against [minX, maxX] x [minY, maxY] area.
+ * Returns true if no part of the segment lies inside the area.
+ * */
+bool clipLineSegment(
+    double startX, double startY, double endX, double endY,
+    double minX, double minY, double maxX, double maxY,
+    double &outStartX, double &outStartY, double &outEndX, double &outEndY
+) {
+  const double deltaX = endX - startX;
+  const double deltaY = endY - startY;
+
+  const double p[4] = {-deltaX, deltaX, -deltaY, deltaY};
+  const double q[4] = {startX - minX, maxX - startX, startY - minY, maxY - startY};
+
+  double enter = 0.0;
+  double exit = 1.0;
+  for (uint8_t edge = 0; edge < 4; edge++) {
+    if (p[edge] == 0.0) {
+      // Parallel to the edge and outside of it
+      if (q[edge] < 0.0) {
+        return true;
+      }
+      continue;
+    }
+
+    double t = q[edge] / p[edge];
+    if (p[edge] < 0.0) {
+      if (t > exit) {
+        return true;
+      }
+      enter = MAX(enter, t);
+    } else {
+      if (t < enter) {
+        return true;
+      }
+      exit = MIN(exit, t);
+    }
+  }
+
+  outStartX = startX + enter * deltaX;
+  outStartY = startY + enter * deltaY;
+  outEndX = startX + exit * deltaX;
+  outEndY = startY + exit * deltaY;
+
+  return false;
+}
+
+/**
+ * Moves line segment given relative to the area center into area coordinates and clips it to the area bounds
+ * extended by margin (e.g. half of the line width).
+ * Returns true if the segment lies entirely outside the area.
+ * Output endpoints are in sub-pixel units of PolylineRasterizer and are guaranteed to be within the extended area,
+ * so rasterization never walks off-screen pixels and coordinates cannot overflow at high zoom levels.
+ * */
 bool centerAndTrimLineSegment(
     double startX, double startY, double endX, double endY,
-    uint16_t areaWidth, uint16_t areaHeight,
-    int16_t &outStartX, int16_t &outStartY, int16_t &outEndX, int16_t &outEndY
+    uint16_t areaWidth, uint16_t areaHeight, double margin,
+    int32_t &outStartX, int32_t &outStartY, int32_t &outEndX, int32_t &outEndY
 ) {
   const double centerX = double(areaWidth) / 2.0;
   const double centerY = double(areaHeight) / 2.0;
@@ -45,23 +146,446 @@ bool centerAndTrimLineSegment(
   auto centeredEndX = centerX + endX;
   auto centeredEndY = centerY + endY;
 
-  if ((centeredStartX < 0 && centeredEndX < 0) ||
-      (centeredStartY < 0 && centeredEndY < 0) ||
-      (centeredStartX >= areaWidth && centeredEndX >= areaWidth) ||
-      (centeredStartY >= areaHeight && centeredEndY >= areaHeight)) {
+  const double minX = -margin;
+  const double minY = -margin;
+  const double maxX = double(areaWidth - 1) + margin;
+  const double maxY = double(areaHeight - 1) + margin;
+
+  // Trivial rejection of segments entirely off one side, which is the case for most of the route.
+  // Kept apart from the clipping itself so this hot path stays cheap.
+  if ((centeredStartX < minX && centeredEndX < minX) ||
+      (centeredStartY < minY && centeredEndY < minY) ||
+      (centeredStartX > maxX && centeredEndX > maxX) ||
+      (centeredStartY > maxY && centeredEndY > maxY)) {
     return true;
   }
 
-  outStartX = int16_t(centeredStartX);
-  outStartY = int16_t(centeredStartY);
-  outEndX = int16_t(centeredEndX);
-  outEndY = int16_t(centeredEndY);
+  double clippedStartX, clippedStartY, clippedEndX, clippedEndY;
+  if (clipLineSegment(centeredStartX, centeredStartY, centeredEndX, centeredEndY, minX, minY, maxX, maxY,
+                      clippedStartX, clippedStartY, clippedEndX, clippedEndY)) {
+    return true;
+  }
+
+  // Integer coordinates address pixel corners in the rasterizer, hence the half pixel shift to their centers
+  outStartX = int32_t(std::lround((clippedStartX + 0.5) * POLYLINE_SUBPIXEL_SCALE));
+  outStartY = int32_t(std::lround((clippedStartY + 0.5) * POLYLINE_SUBPIXEL_SCALE));
+  outEndX = int32_t(std::lround((clippedEndX + 0.5) * POLYLINE_SUBPIXEL_SCALE));
+  outEndY = int32_t(std::lround((clippedEndY + 0.5) * POLYLINE_SUBPIXEL_SCALE));
 
   return false;
 }
 
+/**
+ * Tiles around the location and the affine mapping from pixels of a map image to texels of these tiles,
+ * everything renderMapRows needs to fill any part of the image.
+ * */
+struct MapView {
+  // MAP_VIEW_TILES x MAP_VIEW_TILES tiles from (firstTileX, firstTileY), row by row, nullptr where not available
+  const Tile *tiles[MAP_VIEW_TILES * MAP_VIEW_TILES];
+  int64_t firstTileX;
+  int64_t firstTileY;
+  uint16_t tileWidth;
+  uint16_t tileHeight;
+  uint32_t blockRowSize; // Of tile texels, see Tile::getTexelOffset
+  // Size of the image in the buffer layout expected by drawImageBuffer
+  uint16_t width;
+  uint16_t height;
+  // Texel coordinates (relative to the top-left tile) of the center of pixel (0, 0) and their steps per pixel,
+  // all in 16.16 fixed point
+  int32_t originU;
+  int32_t originV;
+  int32_t stepUPerColumn;
+  int32_t stepVPerColumn;
+  int32_t stepUPerRow;
+  int32_t stepVPerRow;
+  MapSamplingMode samplingMode;
+};
+
+/**
+ * Overscanned map rotated by the heading it was resampled for. Frames keeping the heading are cut out of it,
+ * it is scrolled and only its exposed strips are resampled once the view reaches its edge.
+ * */
+struct MapCache {
+  std::vector<uint16_t> pixels; // MAP_CACHE_WIDTH x MAP_CACHE_HEIGHT, in the map buffer layout
+  MapView view;
+  bool isValid;
+  uint32_t tilesVersion; // Value of mapTilesVersion when resampled
+  double heading;
+  uint8_t mapZoom;
+  // Location (tile coordinates) the cache was resampled around and its current pixel position in the cache
+  double anchorTileX;
+  double anchorTileY;
+  int32_t anchorX;
+  int32_t anchorY;
+};
+
+static MapCache mapCache;
+// Bumped from the bluetooth thread as tiles arrive, possibly while the cache is being resampled
+static std::atomic<uint32_t> mapTilesVersion(0);
+
+static inline int32_t toFixedPoint(double value) {
+  return int32_t(std::lround(value * double(1 << MAP_VIEW_FIXED_POINT_BITS)));
+}
+
+/**
+ * Collects loaded tiles around the location. Returns false if there are no tiles to draw.
+ * */
+static bool prepareMapTiles(
+    const std::map<std::string, Tile *> &tiles, uint8_t mapZoom, double locationTileX, double locationTileY,
+    MapView &view
+) {
+  view.firstTileX = int64_t(std::floor(locationTileX)) - MAP_VIEW_TILES / 2;
+  view.firstTileY = int64_t(std::floor(locationTileY)) - MAP_VIEW_TILES / 2;
+  view.tileWidth = 0;
+  view.tileHeight = 0;
+  view.blockRowSize = 0;
+
+  bool hasTiles = false;
+  for (uint8_t row = 0; row < MAP_VIEW_TILES; row++) {
+    for (uint8_t column = 0; column < MAP_VIEW_TILES; column++) {
+      const Tile *&viewTile = view.tiles[row * MAP_VIEW_TILES + column];
+      viewTile = nullptr;
+      const int64_t tileX = view.firstTileX + column;
+      const int64_t tileY = view.firstTileY + row;
+      if (tileX < 0 || tileY < 0) {
+        continue;
+      }
+
+      auto tile = tiles.find(Tile::getTileKey(uint32_t(tileX), uint32_t(tileY), mapZoom));
+      if (tile == tiles.end() || tile->second == nullptr ||
+          !tile->second->isFullyLoaded() || tile->second->imageData.empty()) {
+        continue;
+      }
+      // All tiles of a zoom level share the same size, the first loaded one defines it
+      if (!hasTiles) {
+        view.tileWidth = tile->second->tileWidth;
+        view.tileHeight = tile->second->tileHeight;
+        view.blockRowSize = Tile::getBlockRowSize(view.tileWidth);
+        hasTiles = true;
+      }
+      if (tile->second->tileWidth == view.tileWidth && tile->second->tileHeight == view.tileHeight) {
+        viewTile = tile->second;
+      }
+    }
+  }
+  return hasTiles;
+}
+
+/**
+ * Precomputes the mapping of the map rotated by heading, with the location in the middle of the image.
+ * */
+static void prepareMapMapping(MapView &view, double locationTileX, double locationTileY, double rotationRad) {
+  // Pixel offset from the image center is rotated by heading and scaled to texels
+  const double cosine = cos(rotationRad);
+  const double sine = sin(rotationRad);
+  const double tileWidth = view.tileWidth;
+  const double tileHeight = view.tileHeight;
+  const double centerU = (locationTileX - double(view.firstTileX)) * tileWidth;
+  const double centerV = (locationTileY - double(view.firstTileY)) * tileHeight;
+  const double offsetX = 0.5 - view.width / 2;
+  const double offsetY = 0.5 - view.height / 2;
+
+  view.stepUPerColumn = toFixedPoint(cosine);
+  view.stepVPerColumn = toFixedPoint(sine * tileHeight / tileWidth);
+  view.stepUPerRow = toFixedPoint(-sine * tileWidth / tileHeight);
+  view.stepVPerRow = toFixedPoint(cosine);
+  view.originU = toFixedPoint(centerU + cosine * offsetX - sine * offsetY * tileWidth / tileHeight);
+  view.originV = toFixedPoint(centerV + sine * offsetX * tileHeight / tileWidth + cosine * offsetY);
+  view.samplingMode = mapSamplingMode;
+}
+
+/**
+ * Returns the tile containing given texel (coordinates relative to the top-left view tile)
+ * or nullptr if it lies outside of available tiles. Texel coordinates within its tile are stored to texelX, texelY.
+ * */
+static inline const Tile *getMapTile(const MapView &view, int32_t u, int32_t v, int32_t &texelX, int32_t &texelY) {
+  if (u < 0 || v < 0) {
+    return nullptr;
+  }
+  const int32_t tileColumn = u / view.tileWidth;
+  const int32_t tileRow = v / view.tileHeight;
+  if (tileColumn >= MAP_VIEW_TILES || tileRow >= MAP_VIEW_TILES) {
+    return nullptr;
+  }
+  const Tile *tile = view.tiles[tileRow * MAP_VIEW_TILES + tileColumn];
+  if (tile == nullptr) {
+    return nullptr;
+  }
+
+  texelX = u - tileColumn * view.tileWidth;
+  texelY = v - tileRow * view.tileHeight;
+  return tile;
+}
+
+// Returns 8-bit RGB channels of given texel or nullptr if it lies outside of available tiles
+static inline const uint8_t *getMapTexel(const MapView &view, int32_t u, int32_t v) {
+  int32_t texelX, texelY;
+  const Tile *tile = getMapTile(view, u, v, texelX, texelY);
+  if (tile == nullptr) {
+    return nullptr;
+  }
+  return &tile->paletteRgb[tile->imageData[Tile::getTexelOffset(view.blockRowSize, texelX, texelY)] * 3];
+}
+
+/**
+ * Fills columns from columnBegin to columnEnd of rows from rowBegin to rowEnd (all exclusive) by sampling view tiles.
+ * Pixels not covered by any tile get the background color.
+ * */
+static void renderMapRows(
+    const MapView &view, uint16_t *buffer,
+    uint16_t columnBegin, uint16_t columnEnd, uint16_t rowBegin, uint16_t rowEnd
+) {
+  static const uint8_t missingTexel[3] = {BACKGROUND_RED, BACKGROUND_GREEN, BACKGROUND_BLUE};
+  const uint16_t background = convertRgbColor(backgroundColor);
+  const int32_t fractionShift = MAP_VIEW_FIXED_POINT_BITS - 8;
+
+  for (uint16_t y = rowBegin; y < rowEnd; y++) {
+    int32_t u = view.originU + int32_t(y) * view.stepUPerRow + int32_t(columnBegin) * view.stepUPerColumn;
+    int32_t v = view.originV + int32_t(y) * view.stepVPerRow + int32_t(columnBegin) * view.stepVPerColumn;
+    // Buffer is rotated by 180 degrees so pixels of a row are visited backwards
+    uint16_t *pixel = buffer + size_t(view.height - 1 - y) * view.width + (view.width - 1 - columnBegin);
+    std::fill_n(pixel - (columnEnd - columnBegin - 1), columnEnd - columnBegin, background);
+
+    for (uint16_t x = columnBegin; x < columnEnd; x++, pixel--, u += view.stepUPerColumn, v += view.stepVPerColumn) {
+      int32_t texelX, texelY;
+      if (view.samplingMode == SAMPLING_NEAREST) {
+        const Tile *tile = getMapTile(view, u >> MAP_VIEW_FIXED_POINT_BITS, v >> MAP_VIEW_FIXED_POINT_BITS,
+                                      texelX, texelY);
+        if (tile != nullptr) {
+          *pixel = tile->palettePanel[tile->imageData[Tile::getTexelOffset(view.blockRowSize, texelX, texelY)]];
+        }
+        continue;
+      }
+
+      // Bilinear interpolation between centers of the four nearest texels, with 8-bit weights
+      const int32_t sampleU = u - (1 << (MAP_VIEW_FIXED_POINT_BITS - 1));
+      const int32_t sampleV = v - (1 << (MAP_VIEW_FIXED_POINT_BITS - 1));
+      const int32_t texelU = sampleU >> MAP_VIEW_FIXED_POINT_BITS;
+      const int32_t texelV = sampleV >> MAP_VIEW_FIXED_POINT_BITS;
+      const int32_t weightU = (sampleU >> fractionShift) & 0xFF;
+      const int32_t weightV = (sampleV >> fractionShift) & 0xFF;
+
+      const uint8_t *topLeft;
+      const uint8_t *topRight;
+      const uint8_t *bottomLeft;
+      const uint8_t *bottomRight;
+      const Tile *tile = getMapTile(view, texelU, texelV, texelX, texelY);
+      if (tile != nullptr && texelX + 1 < view.tileWidth && texelY + 1 < view.tileHeight) {
+        // All four texels lie in the same tile
+        const uint8_t *indices = tile->imageData.data();
+        const uint8_t *paletteRgb = tile->paletteRgb.data();
+        const size_t topLeftOffset = Tile::getTexelOffset(view.blockRowSize, texelX, texelY);
+        const size_t bottomLeftOffset = Tile::getTexelOffset(view.blockRowSize, texelX, texelY + 1);
+        // Right neighbours are the same step away in both rows, the next texel or a texel of the next block
+        const size_t rightStep = Tile::getTexelOffset(view.blockRowSize, texelX + 1, texelY) - topLeftOffset;
+        topLeft = &paletteRgb[indices[topLeftOffset] * 3];
+        topRight = &paletteRgb[indices[topLeftOffset + rightStep] * 3];
+        bottomLeft = &paletteRgb[indices[bottomLeftOffset] * 3];
+        bottomRight = &paletteRgb[indices[bottomLeftOffset + rightStep] * 3];
+      } else {
+        topLeft = getMapTexel(view, texelU, texelV);
+        topRight = getMapTexel(view, texelU + 1, texelV);
+        bottomLeft = getMapTexel(view, texelU, texelV + 1);
+        bottomRight = getMapTexel(view, texelU + 1, texelV + 1);
+      }
+      if (topLeft == nullptr && topRight == nullptr && bottomLeft == nullptr && bottomRight == nullptr) {
+        continue;
+      }
+      // Map edges fade into the background
+      topLeft = topLeft != nullptr ? topLeft : missingTexel;
+      topRight = topRight != nullptr ? topRight : missingTexel;
+      bottomLeft = bottomLeft != nullptr ? bottomLeft : missingTexel;
+      bottomRight = bottomRight != nullptr ? bottomRight : missingTexel;
+
+      uint8_t color[3];
+      for (uint8_t channel = 0; channel < 3; channel++) {
+        const int32_t top = (topLeft[channel] << 8) + (topRight[channel] - topLeft[channel]) * weightU;
+        const int32_t bottom = (bottomLeft[channel] << 8) + (bottomRight[channel] - bottomLeft[channel]) * weightU;
+        color[channel] = uint8_t(((top << 8) + (bottom - top) * weightV) >> 16);
+      }
+      *pixel = convertRgbColor(RGB(color[0], color[1], color[2]));
+    }
+  }
+}
+
+/**
+ * Fills given area of the view image, split into bands rendered by the map workers.
+ * */
+static void renderMapArea(
+    const MapView &view, uint16_t *buffer,
+    uint16_t columnBegin, uint16_t columnEnd, uint16_t rowBegin, uint16_t rowEnd
+) {
+  if (columnBegin >= columnEnd || rowBegin >= rowEnd) {
+    return;
+  }
+  const uint16_t rowCount = rowEnd - rowBegin;
+  mapRenderWorkers->run(mapRenderBands, [&](uint16_t band) {
+    renderMapRows(view, buffer, columnBegin, columnEnd,
+                  rowBegin + band * rowCount / mapRenderBands, rowBegin + (band + 1) * rowCount / mapRenderBands);
+  });
+}
+
+/**
+ * Resamples the whole map cache around the location. Returns false if there are no tiles to draw.
+ * */
+static bool resampleMapCache(
+    const std::map<std::string, Tile *> &tiles, uint8_t mapZoom,
+    double locationTileX, double locationTileY, double heading
+) {
+  MapView &view = mapCache.view;
+  mapCache.tilesVersion = mapTilesVersion;
+  if (!prepareMapTiles(tiles, mapZoom, locationTileX, locationTileY, view)) {
+    return false;
+  }
+  view.width = MAP_CACHE_WIDTH;
+  view.height = MAP_CACHE_HEIGHT;
+  prepareMapMapping(view, locationTileX, locationTileY, degreesToRadians(heading));
+
+  mapCache.pixels.resize(size_t(MAP_CACHE_WIDTH) * MAP_CACHE_HEIGHT);
+  renderMapArea(view, mapCache.pixels.data(), 0, MAP_CACHE_WIDTH, 0, MAP_CACHE_HEIGHT);
+
+  mapCache.heading = heading;
+  mapCache.mapZoom = mapZoom;
+  mapCache.anchorTileX = locationTileX;
+  mapCache.anchorTileY = locationTileY;
+  mapCache.anchorX = MAP_CACHE_WIDTH / 2;
+  mapCache.anchorY = MAP_CACHE_HEIGHT / 2;
+  mapCache.isValid = true;
+  return true;
+}
+
+/**
+ * Moves map cache content by (moveX, moveY) pixels towards its top-left corner and renders exposed strips.
+ * Tiles are collected again around the location, which must lie inside of the moved cache.
+ * Returns false if the cache has to be resampled instead.
+ * */
+static bool scrollMapCache(
+    const std::map<std::string, Tile *> &tiles, int32_t moveX, int32_t moveY,
+    double locationTileX, double locationTileY
+) {
+  MapView &view = mapCache.view;
+  if (std::abs(moveX) >= MAP_CACHE_WIDTH || std::abs(moveY) >= MAP_CACHE_HEIGHT) {
+    return false;
+  }
+
+  const int64_t previousFirstTileX = view.firstTileX;
+  const int64_t previousFirstTileY = view.firstTileY;
+  const uint16_t previousTileWidth = view.tileWidth;
+  const uint16_t previousTileHeight = view.tileHeight;
+  if (!prepareMapTiles(tiles, mapCache.mapZoom, locationTileX, locationTileY, view) ||
+      view.tileWidth != previousTileWidth || view.tileHeight != previousTileHeight) {
+    return false;
+  }
+
+  // Same integer steps as renderMapRows takes, so exposed strips line up with the kept pixels exactly
+  view.originU += moveX * view.stepUPerColumn + moveY * view.stepUPerRow -
+                  int32_t(view.firstTileX - previousFirstTileX) * (view.tileWidth << MAP_VIEW_FIXED_POINT_BITS);
+  view.originV += moveX * view.stepVPerColumn + moveY * view.stepVPerRow -
+                  int32_t(view.firstTileY - previousFirstTileY) * (view.tileHeight << MAP_VIEW_FIXED_POINT_BITS);
+
+  // In the buffer layout the move is a single shift of the whole buffer, pixels wrapped
+  // around row ends fall into the exposed columns
+  uint16_t *pixels = mapCache.pixels.data();
+  const ptrdiff_t pixelCount = ptrdiff_t(MAP_CACHE_WIDTH) * MAP_CACHE_HEIGHT;
+  const ptrdiff_t shift = ptrdiff_t(moveY) * MAP_CACHE_WIDTH + moveX;
+  if (shift > 0) {
+    memmove(pixels + shift, pixels, size_t(pixelCount - shift) * sizeof(uint16_t));
+  } else if (shift < 0) {
+    memmove(pixels, pixels - shift, size_t(pixelCount + shift) * sizeof(uint16_t));
+  }
+
+  const uint16_t keptRowBegin = uint16_t(std::max(-moveY, 0));
+  const uint16_t keptRowEnd = uint16_t(std::min(MAP_CACHE_HEIGHT - moveY, MAP_CACHE_HEIGHT));
+  const uint16_t keptColumnBegin = uint16_t(std::max(-moveX, 0));
+  const uint16_t keptColumnEnd = uint16_t(std::min(MAP_CACHE_WIDTH - moveX, MAP_CACHE_WIDTH));
+  renderMapArea(view, pixels, 0, MAP_CACHE_WIDTH, 0, keptRowBegin);
+  renderMapArea(view, pixels, 0, MAP_CACHE_WIDTH, keptRowEnd, MAP_CACHE_HEIGHT);
+  renderMapArea(view, pixels, 0, keptColumnBegin, keptRowBegin, keptRowEnd);
+  renderMapArea(view, pixels, keptColumnEnd, MAP_CACHE_WIDTH, keptRowBegin, keptRowEnd);
+
+  mapCache.anchorX -= moveX;
+  mapCache.anchorY -= moveY;
+  return true;
+}
+
+/**
+ * Fills the map buffer from the map cache, resampled only on heading, zoom or tiles change.
+ * Location is snapped to the cache pixel grid and updated, so overlays stay aligned with the map.
+ * Returns false if there are no tiles to draw.
+ * */
+static bool renderMapLayer(
+    const std::map<std::string, Tile *> &tiles, uint8_t mapZoom,
+    double &locationTileX, double &locationTileY, double heading,
+    uint16_t *buffer
+) {
+  if (!mapCache.isValid || mapCache.tilesVersion != mapTilesVersion ||
+      mapCache.heading != heading || mapCache.mapZoom != mapZoom || mapCache.view.samplingMode != mapSamplingMode) {
+    if (!resampleMapCache(tiles, mapZoom, locationTileX, locationTileY, heading)) {
+      mapCache.isValid = false;
+      return false;
+    }
+  }
+
+  // Location shift since resampling in rotated map pixels (inverse of the texel mapping)
+  const MapView &view = mapCache.view;
+  const double rotationRad = degreesToRadians(heading);
+  const double cosine = cos(rotationRad);
+  const double sine = sin(rotationRad);
+  const double aspectRatio = double(view.tileWidth) / double(view.tileHeight);
+  const double deltaU = (locationTileX - mapCache.anchorTileX) * view.tileWidth;
+  const double deltaV = (locationTileY - mapCache.anchorTileY) * view.tileHeight;
+  const auto shiftX = int32_t(std::lround(cosine * deltaU + sine * aspectRatio * deltaV));
+  const auto shiftY = int32_t(std::lround(-sine / aspectRatio * deltaU + cosine * deltaV));
+  locationTileX = mapCache.anchorTileX + (cosine * shiftX - sine * aspectRatio * shiftY) / view.tileWidth;
+  locationTileY = mapCache.anchorTileY + (sine / aspectRatio * shiftX + cosine * shiftY) / view.tileHeight;
+
+  int32_t windowX = mapCache.anchorX + shiftX - MAP_WIDTH / 2;
+  int32_t windowY = mapCache.anchorY + shiftY - MAP_HEIGHT / 2;
+  if (windowX < 0 || windowY < 0 || windowX > MAP_CACHE_WIDTH - MAP_WIDTH || windowY > MAP_CACHE_HEIGHT - MAP_HEIGHT) {
+    // Center the cache on the view again
+    if (!scrollMapCache(tiles, windowX - MAP_OVERSCAN, windowY - MAP_OVERSCAN, locationTileX, locationTileY)) {
+      mapCache.isValid = false;
+      return renderMapLayer(tiles, mapZoom, locationTileX, locationTileY, heading, buffer);
+    }
+    windowX = MAP_OVERSCAN;
+    windowY = MAP_OVERSCAN;
+  }
+
+  // Both images share the rotated layout, the window's rows are contiguous in the cache
+  for (uint16_t y = 0; y < MAP_HEIGHT; y++) {
+    const uint16_t *source = mapCache.pixels.data() +
+                             size_t(MAP_CACHE_HEIGHT - 1 - windowY - y) * MAP_CACHE_WIDTH +
+                             (MAP_CACHE_WIDTH - windowX - MAP_WIDTH);
+    memcpy(buffer + size_t(MAP_HEIGHT - 1 - y) * MAP_WIDTH, source, MAP_WIDTH * sizeof(uint16_t));
+  }
+  return true;
+}
+
+void renderer::setMapSamplingMode(MapSamplingMode mode) {
+  mapSamplingMode = mode;
+}
+
+void renderer::setMapRenderThreads(uint8_t workerCount, uint16_t bandCount) {
+  if (mapRenderWorkers->getThreadCount() != workerCount + 1) {
+    mapRenderWorkers.reset(new WorkerPool(workerCount));
+  }
+  mapRenderBands = MAX(bandCount, uint16_t(1));
+}
+
+const MapRenderTimes &renderer::getLastMapRenderTimes() {
+  return lastMapRenderTimes;
+}
+
+void renderer::invalidateMapCache() {
+  mapTilesVersion++;
+}
+
 void renderer::prepareMainView() {
   clearScreen(backgroundColor);
+  drawnBatteryText.clear();
+  drawnSlopeText.clear();
+  drawnSpeedText.clear();
+  drawnDirectionArrowStep = DIRECTION_ARROW_STEPS;
   drawTextLine("Waiting for map data",
                0, LCD_2IN4_HEIGHT * 3 / 4 - Font16.Height / 2, LCD_2IN4_WIDTH,
                WHITE, backgroundColor, &Font16, ALIGN_CENTER);
@@ -81,8 +605,10 @@ void renderer::renderMap(
   auto tourLineColor = RGB(255, 167, 38);
 
   uint16_t *buffer = allocateImageBuffer(MAP_WIDTH, MAP_HEIGHT);
-  Paint_NewImage(buffer, MAP_WIDTH, MAP_HEIGHT, 0, WHITE, 24);
-  Paint_Clear(backgroundColor);
+  if (buffer == nullptr) {
+    return;
+  }
+  Canvas canvas(buffer, MAP_WIDTH, MAP_HEIGHT, MAP_WIDTH);
 
   uint16_t tileWidth = 256;
   uint16_t tileHeight = 256;
@@ -93,99 +619,61 @@ void renderer::renderMap(
   auto locationTileY = std::get<1>(locationTileXY);
   double rotationRad = degreesToRadians(location.heading);
 
-  if (!tiles.empty()) {
-    auto referenceTile = tiles.begin();
+  auto stageStart = std::chrono::steady_clock::now();
+  if (renderMapLayer(tiles, mapZoom, locationTileX, locationTileY, location.heading, buffer)) {
     // Override with real tile size
-    tileWidth = referenceTile->second->tileWidth;
-    tileHeight = referenceTile->second->tileHeight;
-
-    for (uint16_t y = 0; y < MAP_HEIGHT; y++) {
-      for (uint16_t x = 0; x < MAP_WIDTH; x++) {
-        uint16_t index = (MAP_HEIGHT - 1 - y) * MAP_WIDTH + (MAP_WIDTH - 1 - x);
-
-        double pixelTileX = double(x - centerX) / double(tileWidth) + locationTileX;
-        double pixelTileY = double(y - centerY) / double(tileHeight) + locationTileY;
-        rotateAroundPivot(pixelTileX, pixelTileY, locationTileX, locationTileY,
-                          rotationRad, pixelTileX, pixelTileY);
-
-        auto tileKey = Tile::getTileKey(uint32_t(pixelTileX), uint32_t(pixelTileY), mapZoom);
-        if (tiles.find(tileKey) == tiles.end()) {
-          continue;
-        }
-
-        Tile *tile = tiles.at(tileKey);
-        if (tile == nullptr || !tile->isFullyLoaded() || tile->imageData.empty()) {
-          continue;
-        }
-
-        double relativeTileX = pixelTileX - double(tile->x); // 0 to 1
-        double relativeTileY = pixelTileY - double(tile->y); // 0 to 1
-
-        ASSERT(relativeTileX >= 0 && relativeTileX <= 1, "Relative tile X out of bounds");
-        ASSERT(relativeTileY >= 0 && relativeTileY <= 1, "Relative tile Y out of bounds");
-        auto tileImageX = uint16_t(relativeTileY * double(tile->tileWidth));
-        auto tileImageY = uint16_t(relativeTileX * double(tile->tileHeight));
-
-#if USE_DEBUG
-        if (tileImageX == 0 || tileImageY == 0 ||
-            tileImageX == tile->tileWidth - 1 || tileImageY == tile->tileHeight - 1) {
-          buffer[index] = GREEN;
-          continue;
-        }
-#endif
-
-        uint16_t tileIndex = tileImageX * tile->tileWidth + tileImageY;
-        ASSERT(tileIndex * 3 + 2 < tile->imageData.size(), "Tile index out of bounds");
-
-        buffer[index] = convertRgbColor(
-            RGB(
-                tile->imageData[tileIndex * 3 + 0],
-                tile->imageData[tileIndex * 3 + 1],
-                tile->imageData[tileIndex * 3 + 2]
-            )
-        );
-      }
-    }
+    tileWidth = mapCache.view.tileWidth;
+    tileHeight = mapCache.view.tileHeight;
+  } else {
+    canvas.clear(backgroundColor);
   }
-
-  const std::vector<Tour::ClusteredPoint> &points = tour.getNearbyPoints(
+  auto stageEnd = std::chrono::steady_clock::now();
+  lastMapRenderTimes.mapLayer = std::chrono::duration<double, std::milli>(stageEnd - stageStart).count();
+
+  // Tour is not changed by the bluetooth thread (e.g. on a zoom change) while it is drawn
+  auto tourLock = tour.lockIndex();
+  stageStart = std::chrono::steady_clock::now();
+  tourLineRasterizer.begin(TOUR_LINE_WIDTH * POLYLINE_SUBPIXEL_SCALE);
+  const Tour::ClusteredPoints &points = tour.getClusteredPoints();
+  const std::vector<Tour::PointsRange> &nearbyRanges = tour.getNearbyPoints(
       location.latitude, location.longitude, 3
   );
-  if (!points.empty()) {
-    for (size_t i = 1; i < points.size(); i++) {
-      auto &previous = points[i - 1];
-
-      // Draw line between adjacent points (prevent from looping between two separate segments)
-      if (previous.pointIndex + 1 != points[i].pointIndex) {
+  for (const auto &range: nearbyRanges) {
+    for (uint32_t i = range.begin; i < range.end; i++) {
+      // Draw line to the adjacent point (prevent from looping between two separate segments)
+      uint32_t next = points.nextPoint[i];
+      if (next == TOUR_NO_POINT) {
         continue;
       }
 
-      auto startX = (previous.tileX - locationTileX) * double(tileWidth);
-      auto startY = (previous.tileY - locationTileY) * double(tileHeight);
-      auto endX = (points[i].tileX - locationTileX) * double(tileWidth);
-      auto endY = (points[i].tileY - locationTileY) * double(tileHeight);
+      auto startX = (points.tileX[i] - locationTileX) * double(tileWidth);
+      auto startY = (points.tileY[i] - locationTileY) * double(tileHeight);
+      auto endX = (points.tileX[next] - locationTileX) * double(tileWidth);
+      auto endY = (points.tileY[next] - locationTileY) * double(tileHeight);
 
       rotateAroundPivot(startX, startY, 0, 0, -rotationRad, startX, startY);
       rotateAroundPivot(endX, endY, 0, 0, -rotationRad, endX, endY);
 
-      int16_t lineStartX, lineStartY, lineEndX, lineEndY;
+      int32_t lineStartX, lineStartY, lineEndX, lineEndY;
       bool outOfBounds = centerAndTrimLineSegment(
           startX, startY, endX, endY,
-          MAP_WIDTH, MAP_HEIGHT,
+          MAP_WIDTH, MAP_HEIGHT, TOUR_LINE_WIDTH,
           lineStartX, lineStartY, lineEndX, lineEndY
       );
       if (outOfBounds) {
         continue;
       }
 
-      Paint_DrawLine(lineStartX, lineStartY, lineEndX, lineEndY,
-                     tourLineColor, DOT_PIXEL_2X2, LINE_STYLE_SOLID);
+      tourLineRasterizer.addSegment(lineStartX, lineStartY, lineEndX, lineEndY);
     }
   }
+  tourLineRasterizer.finish(buffer, tourLineColor);
+  stageEnd = std::chrono::steady_clock::now();
+  lastMapRenderTimes.tour = std::chrono::duration<double, std::milli>(stageEnd - stageStart).count();
 
   const std::vector<Tour::PointOfInterest> &pointsOfInterest = tour.getPointsOfInterest();
   for (const auto &point: pointsOfInterest) {
-    auto pointPosition = Tile::convertLatLongToTileXY(point.latitude, point.longitude, mapZoom);
+    auto pointPosition = Tile::convertMercatorToTileXY(point.mercatorX, point.mercatorY, mapZoom);
 
     auto endX = (pointPosition.first - locationTileX) * double(tileWidth);
     auto endY = (pointPosition.second - locationTileY) * double(tileHeight);
@@ -201,17 +689,14 @@ void renderer::renderMap(
       continue;
     }
 
-    Paint_DrawCircle(centeredEndX, centeredEndY, 6,
-                     BLACK, DOT_PIXEL_1X1, DRAW_FILL_FULL);
-    Paint_DrawCircle(centeredEndX, centeredEndY, 4,
-                     tourLineColor, DOT_PIXEL_1X1, DRAW_FILL_FULL);
+    canvas.fillCircle(centeredEndX, centeredEndY, 6, BLACK);
+    canvas.fillCircle(centeredEndX, centeredEndY, 4, tourLineColor);
   }
+  tourLock.unlock();
 
   // Draw current location dot
-  Paint_DrawCircle(centerX, centerY, 6,
-                   currentLocationOutlineColor, DOT_PIXEL_1X1, DRAW_FILL_FULL);
-  Paint_DrawCircle(centerX, centerY, 3,
-                   BLACK, DOT_PIXEL_1X1, DRAW_FILL_FULL);
+  canvas.fillCircle(centerX, centerY, 6, currentLocationOutlineColor);
+  canvas.fillCircle(centerX, centerY, 3, BLACK);
 
   // Draw outlined circle as area of uncertainty, based on GPS accuracy
   //Spixel = C ∙ cos(latitude) / 2 (zoomlevel + 8); // https://wiki.openstreetmap.org/wiki/Zoom_levels
@@ -220,55 +705,127 @@ void renderer::renderMap(
   auto accuracyPixelsRadius = uint16_t(location.accuracy / metersPerPixel);
   uint16_t radius = std::min(accuracyPixelsRadius, uint16_t(MAP_WIDTH / 2));
   if (radius > 1) {
-    Paint_DrawCircle(centerX, centerY, radius,
-                     CYAN, DOT_PIXEL_1X1, DRAW_FILL_EMPTY);
+    canvas.drawCircle(centerX, centerY, radius, CYAN);
   }
 
   drawImageBuffer(buffer, 0, LCD_2IN4_HEIGHT - MAP_HEIGHT, MAP_WIDTH, MAP_HEIGHT);
   free(buffer);
 }
 
-void renderer::drawSpeed(double speed, const Icons &icons) {
+/**
+ * Blends a grey-alpha digit image over the background into a sprite of given size.
+ * Reduced sizes average the source pixels covered by each sprite pixel, weighted by their alpha.
+ * */
+static void blendDigitSprite(const std::vector<uint8_t> &imageData, uint16_t width, uint16_t height, Sprite &sprite) {
+  const uint16_t channelCount = 2;
+
+  sprite.width = width;
+  sprite.height = height;
+  sprite.pixels.resize(size_t(width) * height);
+
+  for (uint16_t y = 0; y < height; y++) {
+    const uint16_t sourceStartY = y * DIGIT_HEIGHT / height;
+    const uint16_t sourceEndY = std::max(uint16_t((y + 1) * DIGIT_HEIGHT / height), uint16_t(sourceStartY + 1));
+
+    for (uint16_t x = 0; x < width; x++) {
+      const uint16_t sourceStartX = x * DIGIT_WIDTH / width;
+      const uint16_t sourceEndX = std::max(uint16_t((x + 1) * DIGIT_WIDTH / width), uint16_t(sourceStartX + 1));
+
+      uint32_t weightedGreySum = 0;
+      uint32_t alphaSum = 0;
+      for (uint16_t sourceY = sourceStartY; sourceY < sourceEndY; sourceY++) {
+        for (uint16_t sourceX = sourceStartX; sourceX < sourceEndX; sourceX++) {
+          uint16_t pixelIndex = (sourceY * DIGIT_WIDTH + sourceX) * channelCount;
+          weightedGreySum += imageData[pixelIndex] * imageData[pixelIndex + 1];
+          alphaSum += imageData[pixelIndex + 1];
+        }
+      }
+
+      const uint32_t sourceCount = uint32_t(sourceEndX - sourceStartX) * (sourceEndY - sourceStartY);
+      auto grey = double(alphaSum > 0 ? weightedGreySum / alphaSum : 0);
+      auto alphaFactor = double(alphaSum) / double(sourceCount) / 255.0;
+      sprite.pixels[(height - 1 - y) * width + (width - 1 - x)] = convertRgbColor(
+          RGB(
+              uint8_t(mix(BACKGROUND_RED, grey, alphaFactor)),
+              uint8_t(mix(BACKGROUND_GREEN, grey, alphaFactor)),
+              uint8_t(mix(BACKGROUND_BLUE, grey, alphaFactor))
+          )
+      );
+    }
+  }
+}
+
+void renderer::prepareDigitSprites(Icons &icons) {
   ASSERT(icons.digits40x80ImageData.size() == 10, "Invalid digits count");
-  const auto roundedSpeed = uint16_t(std::round(speed));
-  const uint8_t speedDigits = roundedSpeed >= 10 ? 2 : 1;
+
+  icons.digitSprites.resize(10);
+  icons.smallDigitSprites.resize(10);
+  for (uint8_t digit = 0; digit < 10; digit++) {
+    blendDigitSprite(icons.digits40x80ImageData[digit], DIGIT_WIDTH, DIGIT_HEIGHT, icons.digitSprites[digit]);
+    blendDigitSprite(icons.digits40x80ImageData[digit], SMALL_DIGIT_WIDTH, SMALL_DIGIT_HEIGHT,
+                     icons.smallDigitSprites[digit]);
+  }
+
+  Sprite &point = icons.decimalPointSprite;
+  point.width = DECIMAL_POINT_WIDTH;
+  point.height = SMALL_DIGIT_HEIGHT;
+  point.pixels.resize(size_t(point.width) * point.height);
+  Canvas canvas(point.pixels.data(), point.width, point.height, point.width);
+  canvas.clear(backgroundColor);
+  canvas.fillCircle(point.width / 2, point.height * 7 / 8, point.width / 2 - 1, WHITE);
+}
+
+void renderer::drawSpeed(double speed, const Icons &icons) {
+  ASSERT(icons.digitSprites.size() == 10 && icons.smallDigitSprites.size() == 10, "Digit sprites not prepared");
   const uint16_t imageWidth = TOP_PANEL_HEIGHT;
   const uint16_t imageHeight = TOP_PANEL_HEIGHT;
-  const uint16_t digitWidth = 40;
-  const uint16_t digitHeight = 80;
-  const uint16_t channelCount = 2;
+
+  speed = std::max(0.0, std::min(speed, 999.0));
+  char speedText[8];
+  if (SPEED_SHOW_TENTHS && speed < 99.95) {
+    snprintf(speedText, sizeof(speedText), "%.1f", speed);
+  } else {
+    snprintf(speedText, sizeof(speedText), "%d", int(std::lround(speed)));
+  }
+  if (drawnSpeedText == speedText) {
+    return;
+  }
+
+  // Large digits are used for the integer part as long as the whole text fits the widget
+  const size_t textLength = strlen(speedText);
+  const size_t integerDigits = strcspn(speedText, ".");
+  const bool largeIntegerDigits = integerDigits == textLength ? integerDigits <= 2 : integerDigits == 1;
+
+  const Sprite *glyphs[sizeof(speedText)];
+  uint16_t textWidth = 0;
+  for (size_t i = 0; i < textLength; i++) {
+    if (speedText[i] == '.') {
+      glyphs[i] = &icons.decimalPointSprite;
+    } else {
+      uint8_t digit = speedText[i] - '0';
+      glyphs[i] = largeIntegerDigits && i < integerDigits ? &icons.digitSprites[digit] : &icons.smallDigitSprites[digit];
+    }
+    textWidth += glyphs[i]->width;
+  }
 
   uint16_t *imageBuffer = allocateImageBuffer(imageWidth, imageHeight);
   if (imageBuffer == nullptr) {
     return;
   }
-  Paint_NewImage(imageBuffer, imageWidth, imageHeight, 0, WHITE, 24);
-  Paint_Clear(backgroundColor);
-
-  for (uint8_t digitIndex = 0; digitIndex < speedDigits; digitIndex++) {
-    uint8_t digit = (digitIndex == 0 ? roundedSpeed / 10 : roundedSpeed) % 10;
-    auto imageData = icons.digits40x80ImageData[digit];
-
-    for (uint16_t y = 0; y < digitHeight; y++) {
-      for (uint16_t x = 0; x < digitWidth; x++) {
-        uint16_t relativeX = speedDigits > 1 ? digitIndex * digitWidth + x : (imageWidth - digitWidth) / 2 + x;
-        uint16_t index = (imageHeight - 1 - y) * imageWidth + (imageWidth - 1 - relativeX);
-
-        uint16_t pixelIndex = (y * digitWidth + x) * channelCount;
-        auto alphaFactor = double(imageData[pixelIndex + 1]) / 255.0;
-        imageBuffer[index] = convertRgbColor(
-            RGB(
-                uint8_t(mix(BACKGROUND_RED, imageData[pixelIndex], alphaFactor)),
-                uint8_t(mix(BACKGROUND_GREEN, imageData[pixelIndex], alphaFactor)),
-                uint8_t(mix(BACKGROUND_BLUE, imageData[pixelIndex], alphaFactor))
-            )
-        );
-      }
-    }
+  Canvas canvas(imageBuffer, imageWidth, imageHeight, imageWidth);
+  canvas.clear(backgroundColor);
+
+  // Glyphs share the bottom line, small ones alone are centered vertically
+  const uint16_t bottom = largeIntegerDigits ? imageHeight : (imageHeight + SMALL_DIGIT_HEIGHT) / 2;
+  int32_t x = (imageWidth - textWidth) / 2;
+  for (size_t i = 0; i < textLength; i++) {
+    canvas.copyImage(x, bottom - glyphs[i]->height, glyphs[i]->pixels.data(), glyphs[i]->width, glyphs[i]->height);
+    x += glyphs[i]->width;
   }
 
   drawImageBuffer(imageBuffer, (LCD_2IN4_WIDTH - imageWidth) / 2, 0, imageWidth, imageHeight);
   free(imageBuffer);
+  drawnSpeedText = speedText;
 }
 
 void renderer::drawBattery(uint8_t percentage, bool isOverheated) {
@@ -277,8 +834,15 @@ void renderer::drawBattery(uint8_t percentage, bool isOverheated) {
   const uint16_t widgetWidth = imageWidth / 3;
   const uint16_t widgetHeight = widgetWidth / 2;
   const uint16_t widgetHeadWidth = 4;
+  const uint16_t widgetLineWidth = 3;
   const uint16_t gapY = 4;
 
+  std::string batteryPercentageText = std::to_string(percentage) + "%";
+  std::string widgetText = batteryPercentageText + (isOverheated ? " TOO HOT" : "");
+  if (widgetText == drawnBatteryText) {
+    return;
+  }
+
   uint16_t *imageBuffer = allocateImageBuffer(imageWidth, imageHeight);
   if (imageBuffer == nullptr) {
     return;
@@ -292,42 +856,36 @@ void renderer::drawBattery(uint8_t percentage, bool isOverheated) {
       uint8_t(mix(115, 214, factor)),
       uint8_t(mix(115, 167, factor))
   );
-  auto errorColor = RGB(229, 115, 115);
+  batteryTextAtlas.prepare(&Font16, batteryColor, backgroundColor);
 
-  Paint_NewImage(imageBuffer, imageWidth, imageHeight, 0, WHITE, 16);
-  Paint_Clear(backgroundColor);
+  Canvas canvas(imageBuffer, imageWidth, imageHeight, imageWidth);
+  canvas.clear(backgroundColor);
 
-  Paint_DrawRectangle(xStart, yStart, xStart + widgetWidth * uint16_t(percentage) / 100, yStart + widgetHeight,
-                      batteryColor, DOT_PIXEL_2X2, DRAW_FILL_FULL);
-  Paint_DrawRectangle(xStart, yStart, xStart + widgetWidth, yStart + widgetHeight,
-                      batteryColor, DOT_PIXEL_2X2, DRAW_FILL_EMPTY);
-  Paint_DrawRectangle(xStart + widgetWidth, yStart + widgetHeight / 2 - widgetHeight / 4,
-                      xStart + widgetWidth + widgetHeadWidth, yStart + widgetHeight / 2 + widgetHeight / 4,
-                      batteryColor, DOT_PIXEL_2X2, DRAW_FILL_FULL);
+  canvas.fillRectangle(xStart, yStart, widgetWidth * uint16_t(percentage) / 100, widgetHeight, batteryColor);
+  canvas.drawRectangle(xStart, yStart, widgetWidth, widgetHeight, widgetLineWidth, batteryColor);
+  canvas.fillRectangle(xStart + widgetWidth, yStart + widgetHeight / 2 - widgetHeight / 4,
+                       widgetHeadWidth, widgetHeight / 2, batteryColor);
 
-  std::string batteryPercentageText = std::to_string(percentage) + "%";
   uint16_t aligned_x = (imageWidth - Font16.Width * batteryPercentageText.length()) / 2;
-  Paint_DrawString_EN(aligned_x, imageHeight / 2 + gapY / 2, batteryPercentageText.c_str(), &Font16,
-                      backgroundColor, batteryColor);
+  canvas.drawString(aligned_x, imageHeight / 2 + gapY / 2, batteryPercentageText.c_str(), batteryTextAtlas);
 
   if (isOverheated) {
-    Paint_DrawString_EN(0, 0, "TOO HOT", &Font16,
-                        backgroundColor, errorColor);
+    canvas.drawString(0, 0, "TOO HOT", batteryErrorTextAtlas);
   }
 
   drawImageBuffer(imageBuffer, 0, 0, imageWidth, imageHeight);
   free(imageBuffer);
+  drawnBatteryText = widgetText;
 }
 
-void renderer::drawDirectionArrow(double heading, const Icons &icons) {
+/**
+ * Rotates the direction arrow icon by given heading and blends it over the background.
+ * Target buffer uses the panel layout expected by drawImageBuffer.
+ * */
+static void renderDirectionArrow(double heading, const Icons &icons, uint16_t *imageBuffer) {
   const uint16_t imageWidth = icons.directionArrowSize.first;
   const uint16_t imageHeight = icons.directionArrowSize.second;
-  const auto imageData = icons.directionArrowImageData;
-
-  uint16_t *imageBuffer = allocateImageBuffer(imageWidth, imageHeight);
-  if (imageBuffer == nullptr) {
-    return;
-  }
+  const auto &imageData = icons.directionArrowImageData;
 
   auto rotationRad = degreesToRadians(heading);
 
@@ -355,26 +913,58 @@ void renderer::drawDirectionArrow(double heading, const Icons &icons) {
       );
     }
   }
+}
 
-  drawImageBuffer(imageBuffer, LCD_2IN4_WIDTH - imageWidth, 0, imageWidth, imageHeight);
-  free(imageBuffer);
-  imageBuffer = nullptr;
+void renderer::prepareDirectionArrowSprites(Icons &icons) {
+  const size_t spriteSize = size_t(icons.directionArrowSize.first) * icons.directionArrowSize.second;
+  icons.directionArrowSprites.resize(spriteSize * DIRECTION_ARROW_STEPS);
+
+  for (uint16_t step = 0; step < DIRECTION_ARROW_STEPS; step++) {
+    renderDirectionArrow(360.0 * step / DIRECTION_ARROW_STEPS, icons, &icons.directionArrowSprites[spriteSize * step]);
+  }
+}
+
+void renderer::drawDirectionArrow(double heading, const Icons &icons) {
+  const uint16_t imageWidth = icons.directionArrowSize.first;
+  const uint16_t imageHeight = icons.directionArrowSize.second;
+  if (icons.directionArrowSprites.empty()) {
+    return;
+  }
+
+  long step = std::lround(heading * DIRECTION_ARROW_STEPS / 360.0) % DIRECTION_ARROW_STEPS;
+  if (step < 0) {
+    step += DIRECTION_ARROW_STEPS;
+  }
+  if (step == drawnDirectionArrowStep) {
+    return;
+  }
+
+  drawImageBuffer(&icons.directionArrowSprites[size_t(imageWidth) * imageHeight * step],
+                  LCD_2IN4_WIDTH - imageWidth, 0, imageWidth, imageHeight);
+  drawnDirectionArrowStep = step;
 }
 
 void renderer::drawSlope(double slope, double altitude, const Icons &icons) {
   const uint16_t imageWidth = TOP_PANEL_HEIGHT;
   const uint16_t imageHeight = TOP_PANEL_HEIGHT / 2;
 
+  auto slopeText = std::to_string((int16_t) round(radiansToDegrees(slope))) + "d";
+  auto altitudeText = std::to_string((int16_t) round(altitude)) + "m";
+  std::string widgetText = (slope >= 0 ? "+" : "-") + slopeText + " " + altitudeText;
+  if (widgetText == drawnSlopeText) {
+    return;
+  }
+
   uint16_t *imageBuffer = allocateImageBuffer(imageWidth, imageHeight);
   if (imageBuffer == nullptr) {
     return;
   }
 
-  Paint_NewImage(imageBuffer, imageWidth, imageHeight, 0, WHITE, 24);
-  Paint_Clear(backgroundColor);
+  Canvas canvas(imageBuffer, imageWidth, imageHeight, imageWidth);
+  canvas.clear(backgroundColor);
 
-  const auto imageData = slope >= 0 ? icons.slopeUphillImageData : icons.slopeDownhillImageData;
-  const auto textColor = slope >= 0 ? RGB(255, 235, 238) : RGB(232, 245, 233);
+  const auto &imageData = slope >= 0 ? icons.slopeUphillImageData : icons.slopeDownhillImageData;
+  const GlyphAtlas &textAtlas = slope >= 0 ? slopeUphillTextAtlas : slopeDownhillTextAtlas;
 
   uint8_t iconColorRed = 176;
   uint8_t iconColorGreen = 190;
@@ -401,17 +991,14 @@ void renderer::drawSlope(double slope, double altitude, const Icons &icons) {
     }
   }
 
-  auto slopeText = std::to_string((int16_t) round(radiansToDegrees(slope))) + "d";
   auto aligned_x = MAX(0,
                        int16_t(imageWidth) -icons.slopeIconSize.first - int16_t(Font16.Width) * slopeText.length());
-  Paint_DrawString_EN(uint16_t(aligned_x), imageHeight / 2 - Font16.Height, slopeText.c_str(), &Font16,
-                      backgroundColor, textColor);
+  canvas.drawString(aligned_x, imageHeight / 2 - Font16.Height, slopeText.c_str(), textAtlas);
 
-  auto altitudeText = std::to_string((int16_t) round(altitude)) + "m";
   aligned_x = MAX(0, int16_t(imageWidth) -icons.slopeIconSize.first - int16_t(Font16.Width) * altitudeText.length());
-  Paint_DrawString_EN(uint16_t(aligned_x), (imageHeight) / 2, altitudeText.c_str(), &Font16,
-                      backgroundColor, textColor);
+  canvas.drawString(aligned_x, (imageHeight) / 2, altitudeText.c_str(), textAtlas);
 
   drawImageBuffer(imageBuffer, LCD_2IN4_WIDTH - imageWidth, TOP_PANEL_HEIGHT / 2, imageWidth, imageHeight);
   free(imageBuffer);
+  drawnSlopeText = widgetText;
 }
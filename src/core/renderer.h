@@ -9,9 +9,54 @@
 #include <iostream>
 #include <map>
 
+/**
+ * Number of pre-rotated direction arrow sprites (3 degrees apart, about one pixel at the tip of the 40x40 arrow).
+ * Each sprite takes 3.2 KB, so the table takes 375 KB, while drawing the arrow becomes a single blit.
+ * */
+#define DIRECTION_ARROW_STEPS 120
+
+// Map is filled in horizontal bands by the drawing thread and the workers. Two workers keep one of the four cores
+// free for the bluetooth thread. More bands than threads even out bands crossing fewer tiles.
+#define MAP_RENDER_WORKERS 2
+#define MAP_RENDER_BANDS 8
+
+enum MapSamplingMode {
+  SAMPLING_NEAREST = 1,
+  SAMPLING_BILINEAR, // Smooth roads on a rotated map, 8-bit fixed point weights
+};
+
+#define TOUR_LINE_WIDTH 3 // pixels
+
+// Route geometry of renderMap, documented in renderer.cpp. Also timed on its own by render_bench.
+bool clipLineSegment(
+    double startX, double startY, double endX, double endY,
+    double minX, double minY, double maxX, double maxY,
+    double &outStartX, double &outStartY, double &outEndX, double &outEndY
+);
+
+bool centerAndTrimLineSegment(
+    double startX, double startY, double endX, double endY,
+    uint16_t areaWidth, uint16_t areaHeight, double margin,
+    int32_t &outStartX, int32_t &outStartY, int32_t &outEndX, int32_t &outEndY
+);
+
+// Stages of a renderMap call, in milliseconds
+struct MapRenderTimes {
+  double mapLayer; // Map resampled from tiles or moved within the map cache
+  double tour; // Route clipped and rasterized
+};
+
 namespace renderer {
   void prepareMainView();
 
+  void setMapSamplingMode(MapSamplingMode mode);
+
+  // Workers filling the map along with the drawing thread and bands they split it into, not to be called mid-frame
+  void setMapRenderThreads(uint8_t workerCount, uint16_t bandCount);
+
+  // Map is resampled from tiles on the next frame, to be called whenever tiles change
+  void invalidateMapCache();
+
   void renderMap(
       const std::map<std::string, Tile *> &tiles,
       Tour &tour,
@@ -19,10 +64,19 @@ namespace renderer {
       uint8_t mapZoom
   );
 
+  const MapRenderTimes &getLastMapRenderTimes();
+
+  // Blends speed digits over the background once, in every size used by drawSpeed
+  void prepareDigitSprites(Icons &icons);
+
+  // Speeds from 100 km/h are shown with reduced digits, as are tenths when SPEED_SHOW_TENTHS is enabled
   void drawSpeed(double speed, const Icons &icons);
 
   void drawBattery(uint8_t percentage, bool isOverheated);
 
+  // Renders the direction arrow in every orientation, icons must be loaded already
+  void prepareDirectionArrowSprites(Icons &icons);
+
   void drawDirectionArrow(double heading, const Icons &icons);
 
   void drawSlope(double slope, double altitude, const Icons &icons);
@@ -8,6 +8,8 @@
 #include <tuple>
 #include <unistd.h>
 
+#define MERCATOR_MAX_LATITUDE 85.0511287798 // Degrees, edge of Web Mercator tiles
+
 std::string Tile::tilesCacheDirectory;
 
 void Tile::initializeTileCacheDirectory() {
@@ -16,66 +18,121 @@ void Tile::initializeTileCacheDirectory() {
   }
 }
 
+void Tile::setCacheDirectory(const std::string &path) {
+  Tile::tilesCacheDirectory = path;
+}
+
 Tile::Tile(uint32_t x, uint32_t y, uint8_t z,
-           uint32_t dataByteLength)
+           uint32_t dataByteLength, uint8_t format)
     : x(x), y(y), z(z),
-      dataByteLength(dataByteLength), key(Tile::getTileKey(x, y, z)) {
+      dataByteLength(dataByteLength), format(format), key(Tile::getTileKey(x, y, z)) {
   this->loadedByteLength = 0;
   this->tileWidth = 0;
   this->tileHeight = 0;
 
   if (dataByteLength > 0) {
-    this->pngData = new uint8_t[dataByteLength];
-    memset(this->pngData, 0, dataByteLength * sizeof(uint8_t));
+    this->receivedData = new uint8_t[dataByteLength];
+    memset(this->receivedData, 0, dataByteLength * sizeof(uint8_t));
   } else {
-    this->pngData = nullptr;
+    this->receivedData = nullptr;
   }
 }
 
-Tile::Tile(uint32_t x, uint32_t y, uint8_t z, std::vector<uint8_t> &imageData) : Tile(x, y, z, 0) {
-  this->imageData = imageData;
+Tile::Tile(uint32_t x, uint32_t y, uint8_t z, uint16_t tileWidth, uint16_t tileHeight,
+           const std::vector<uint8_t> &indices, const Rgb565Palette &palette)
+    : Tile(x, y, z, 0) {
+  this->tileWidth = tileWidth;
+  this->tileHeight = tileHeight;
+  this->storeImageData(indices);
+  this->palette = palette;
+  this->preparePalettes();
 }
 
 Tile::~Tile() {
-  delete[] this->pngData;
+  delete[] this->receivedData;
   this->imageData.clear();
 }
 
-void Tile::appendPngData(uint16_t chunkIndex, uint8_t *data) {
+void Tile::appendData(uint16_t chunkIndex, uint8_t *data) {
+  uint32_t offset = TILE_CHUNK_SIZE * uint32_t(chunkIndex);
+  if (offset >= this->dataByteLength) {
+    std::cerr << "Chunk " << chunkIndex << " is out of tile " << this->key << std::endl;
+    return;
+  }
+
   uint32_t bytesLeftToLoad = this->dataByteLength - this->loadedByteLength;
-  uint32_t chunkSize = TILE_CHUNK_SIZE;
+  uint32_t chunkSize = MIN(TILE_CHUNK_SIZE, this->dataByteLength - offset);
   if (chunkSize > bytesLeftToLoad) {
     chunkSize = bytesLeftToLoad;
   }
 
-  uint32_t offset = TILE_CHUNK_SIZE * uint32_t(chunkIndex);
-  memcpy(this->pngData + offset, data, chunkSize);
+  memcpy(this->receivedData + offset, data, chunkSize);
 
   this->loadedByteLength += chunkSize;
+}
 
-  if (this->isFullyLoaded() && this->imageData.empty()) {
-    this->finalize();
+Tile *Tile::decode() const {
+  const TileDecoder *decoder = TileDecoder::forFormat(this->format);
+  std::vector<uint8_t> indices;
+  Rgb565Palette palette;
+  auto tileResolution = decoder->decode(indices, palette, this->receivedData, this->dataByteLength);
+  if (tileResolution.first == 0 || tileResolution.second == 0 || indices.empty()) {
+    std::cerr << "Error decoding tile " << this->key << std::endl;
+    return nullptr;
   }
+
+  this->saveToCache(decoder);
+  return new Tile(this->x, this->y, this->z, tileResolution.first, tileResolution.second, indices, palette);
 }
 
-void Tile::finalize() {
+void Tile::saveToCache(const TileDecoder *decoder) const {
   initializeTileCacheDirectory();
 
-  auto tileResolution = parsePngData(this->imageData, this->pngData, this->dataByteLength);
-  this->tileWidth = std::get<0>(tileResolution);
-  this->tileHeight = std::get<1>(tileResolution);
-
-
   if (safeCreateDirectory(Tile::tilesCacheDirectory.c_str()) != 0) {
     std::cerr << "Error creating directory for tiles cache" << std::endl;
     return;
   }
 
-  std::string tilePath = Tile::tilesCacheDirectory + "/" + this->key + ".png";
-  createOrReplaceFileFromBinaryData(tilePath, this->pngData, this->dataByteLength);
+  // Tile sent again in another format must not be shadowed by its previous cache file
+  for (uint8_t format = 0; format < TILE_FORMATS_COUNT; format++) {
+    if (format != this->format) {
+      safeDeleteFile((Tile::tilesCacheDirectory + "/" + this->key +
+                      TileDecoder::forFormat(format)->getFileExtension()).c_str());
+    }
+  }
+
+  std::string tilePath = Tile::tilesCacheDirectory + "/" + this->key + decoder->getFileExtension();
+  createOrReplaceFileFromBinaryData(tilePath, this->receivedData, this->dataByteLength);
   DEBUG("Tile %s saved to %s\n", this->key.c_str(), tilePath.c_str());
 }
 
+void Tile::preparePalettes() {
+  expandRgb565Palette(this->palette, this->paletteRgb);
+  for (size_t i = 0; i < this->palette.size(); i++) {
+    this->palettePanel[i] = convertRgbColor(this->palette[i]);
+  }
+}
+
+void Tile::storeImageData(const std::vector<uint8_t> &indices) {
+  const uint32_t width = this->tileWidth;
+  const uint32_t height = this->tileHeight;
+  if (indices.size() < size_t(width) * height) {
+    this->imageData.clear();
+    return;
+  }
+
+  // Blocks of tiles not divisible by the block size are padded
+  const uint32_t blockRowSize = Tile::getBlockRowSize(this->tileWidth);
+  const uint32_t blockRows = (height + TILE_BLOCK_SIZE - 1) >> TILE_BLOCK_SIZE_BITS;
+  this->imageData.assign(size_t(blockRowSize) * blockRows, 0);
+  for (uint32_t texelY = 0; texelY < height; texelY++) {
+    for (uint32_t texelX = 0; texelX < width; texelX += TILE_BLOCK_SIZE) {
+      memcpy(&this->imageData[Tile::getTexelOffset(blockRowSize, texelX, texelY)],
+             &indices[size_t(texelY) * width + texelX], MIN(uint32_t(TILE_BLOCK_SIZE), width - texelX));
+    }
+  }
+}
+
 bool Tile::isFullyLoaded() const {
   return this->loadedByteLength >= this->dataByteLength;
 }
@@ -88,38 +145,51 @@ Tile *Tile::loadFromCache(uint32_t x, uint32_t y, uint8_t z) {
   initializeTileCacheDirectory();
 
   auto tileKey = Tile::getTileKey(x, y, z);
-  std::string tilePath = Tile::tilesCacheDirectory + "/" + tileKey + ".png";
-
-  if (access(tilePath.c_str(), F_OK) != 0) {
+  std::string tilePath;
+  const TileDecoder *decoder = nullptr;
+  for (uint8_t format = 0; format < TILE_FORMATS_COUNT && decoder == nullptr; format++) {
+    tilePath = Tile::tilesCacheDirectory + "/" + tileKey + TileDecoder::forFormat(format)->getFileExtension();
+    if (access(tilePath.c_str(), F_OK) == 0) {
+      decoder = TileDecoder::forFormat(format);
+    }
+  }
+  if (decoder == nullptr) {
     return nullptr;
   }
 
-  std::vector<uint8_t> imageData;
-  auto tileResolution = loadPngFile(imageData, tilePath, LCT_RGB);
-  if (tileResolution.first == 0 || tileResolution.second == 0 || imageData.empty()) {
+  std::vector<uint8_t> fileData;
+  std::vector<uint8_t> indices;
+  Rgb565Palette palette;
+  std::pair<uint16_t, uint16_t> tileResolution(0, 0);
+  if (lodepng::load_file(fileData, tilePath) == 0 && !fileData.empty()) {
+    tileResolution = decoder->decode(indices, palette, fileData.data(), uint32_t(fileData.size()));
+  }
+  if (tileResolution.first == 0 || tileResolution.second == 0 || indices.empty()) {
     std::cerr << "Error loading tile from cache: " << tilePath << std::endl;
     // Remove file if it exists as it was probably corrupted when fetching via bluetooth
     safeDeleteFile(tilePath.c_str());
     return nullptr;
   }
 
-  Tile *tile = new Tile(x, y, z, imageData);
-  tile->tileWidth = tileResolution.first;
-  tile->tileHeight = tileResolution.second;
-
-  return tile;
+  return new Tile(x, y, z, tileResolution.first, tileResolution.second, indices, palette);
 }
 
 std::pair<double, double> Tile::convertLatLongToTileXY(double latitude, double longitude, uint8_t zoom) {
-  const double latRad = degreesToRadians(latitude);
-  const auto n = double(pow(2.0, zoom));
-
-  const double x = ((longitude + 180.0) / 360.0) * n;
-  const double y = ((1.0 - asinh(tan(latRad)) / M_PI) / 2.0) * n;
-
-  return std::make_pair(std::fmod(x, n), std::fmod(y, n));
+  auto mercator = Tile::convertLatLongToMercator(latitude, longitude);
+  return Tile::convertMercatorToTileXY(mercator.first, mercator.second, zoom);
 }
 
+std::pair<double, double> Tile::convertLatLongToMercator(double latitude, double longitude) {
+  // Polar latitudes are projected to the top or bottom map edge, y stays within [0, 1) for tile indices
+  const double latRad = degreesToRadians(MAX(-MERCATOR_MAX_LATITUDE, MIN(latitude, MERCATOR_MAX_LATITUDE)));
 
+  const double x = (longitude + 180.0) / 360.0;
+  const double y = (1.0 - asinh(tan(latRad)) / M_PI) / 2.0;
 
+  return std::make_pair(std::fmod(x, 1.0), MAX(0.0, MIN(y, std::nextafter(1.0, 0.0))));
+}
 
+std::pair<double, double> Tile::convertMercatorToTileXY(double mercatorX, double mercatorY, uint8_t zoom) {
+  const auto n = double(uint64_t(1) << zoom);
+  return std::make_pair(mercatorX * n, mercatorY * n);
+}
@@ -1,17 +1,24 @@
 #ifndef TILE_H
 #define TILE_H
 
+#include "tileDecoder.h"
+
 #include <cstdint>
 #include <iostream>
 #include <vector>
 
 #define TILE_CHUNK_SIZE 224
+#define TILE_BLOCK_SIZE_BITS 3 // Texels are stored in 8x8 blocks, one 64 byte cache line of indices each
+#define TILE_BLOCK_SIZE (1 << TILE_BLOCK_SIZE_BITS)
 
 class Tile {
 public:
-  Tile(uint32_t x, uint32_t y, uint8_t z, uint32_t dataByteLength);
+  // Tile received in given format (see TileFormat), filled by appendData and decoded by decode
+  Tile(uint32_t x, uint32_t y, uint8_t z, uint32_t dataByteLength, uint8_t format = TILE_FORMAT_PNG);
 
-  Tile(uint32_t x, uint32_t y, uint8_t z, std::vector<uint8_t> &imageData);
+  // Decoded tile of given palette indices, row by row
+  Tile(uint32_t x, uint32_t y, uint8_t z, uint16_t tileWidth, uint16_t tileHeight,
+       const std::vector<uint8_t> &indices, const Rgb565Palette &palette);
 
   ~Tile();
 
@@ -20,8 +27,17 @@ public:
   // Returns pointer to a new Tile object that must be deleted by the caller
   static Tile *loadFromCache(uint32_t x, uint32_t y, uint8_t z);
 
+  // Overrides the default tiles_cache directory next to the executable directory
+  static void setCacheDirectory(const std::string &path);
+
   static std::pair<double, double> convertLatLongToTileXY(double latitude, double longitude, uint8_t zoom);
 
+  // Zoom independent Web-Mercator projection with both coordinates normalized to 0..1 range
+  static std::pair<double, double> convertLatLongToMercator(double latitude, double longitude);
+
+  // Cheap scaling of normalized Mercator coordinates to tile coordinates at given zoom (no transcendental math)
+  static std::pair<double, double> convertMercatorToTileXY(double mercatorX, double mercatorY, uint8_t zoom);
+
   const std::string key;
   const uint32_t x;
   const uint32_t y;
@@ -29,9 +45,34 @@ public:
   uint16_t tileWidth;
   uint16_t tileHeight;
   const uint32_t dataByteLength;
-  std::vector<uint8_t> imageData;
+  const uint8_t format;
+  std::vector<uint8_t> imageData; // Palette index of every texel, see getTexelOffset
+  Rgb565Palette palette;
+  Rgb888Palette paletteRgb;
+  Rgb565Palette palettePanel; // In the byte order of the display, see convertRgbColor
+
+  void appendData(uint16_t chunkIndex, uint8_t *data);
 
-  void appendPngData(uint16_t chunkIndex, uint8_t *data);
+  /**
+   * Decodes the received data into a new Tile object that must be deleted by the caller and saves the data to
+   * the tiles cache. Returns nullptr if the data cannot be decoded.
+   * */
+  Tile *decode() const;
+
+  // Bytes of imageData per row of blocks of tiles of given width
+  static uint32_t getBlockRowSize(uint16_t tileWidth) {
+    return ((uint32_t(tileWidth) + TILE_BLOCK_SIZE - 1) >> TILE_BLOCK_SIZE_BITS) << (2 * TILE_BLOCK_SIZE_BITS);
+  }
+
+  /**
+   * Offset of given texel in imageData. Texels are stored block by block, row by row within a block, so the
+   * neighbourhood of a texel stays in a few cache lines whichever direction the map is sampled in.
+   * */
+  static size_t getTexelOffset(uint32_t blockRowSize, uint32_t texelX, uint32_t texelY) {
+    return size_t(texelY >> TILE_BLOCK_SIZE_BITS) * blockRowSize +
+           ((texelX & ~uint32_t(TILE_BLOCK_SIZE - 1)) << TILE_BLOCK_SIZE_BITS) +
+           ((texelY & (TILE_BLOCK_SIZE - 1)) << TILE_BLOCK_SIZE_BITS) + (texelX & (TILE_BLOCK_SIZE - 1));
+  }
 
   bool isFullyLoaded() const;
 
@@ -39,9 +80,15 @@ private:
   static void initializeTileCacheDirectory();
   static std::string tilesCacheDirectory;
   uint32_t loadedByteLength;
-  uint8_t *pngData;
+  uint8_t *receivedData; // Encoded in format, kept until the tile is cached
+
+  void saveToCache(const TileDecoder *decoder) const;
+
+  // Derives paletteRgb and palettePanel from palette
+  void preparePalettes();
 
-  void finalize();
+  // Stores indices of tileWidth x tileHeight texels, row by row, to imageData in blocks
+  void storeImageData(const std::vector<uint8_t> &indices);
 };
 
 #endif // TILE_H
\ No newline at end of file
@@ -0,0 +1,283 @@
+#include "tileDecoder.h"
+#include "pngUtils.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+#define TILE_DECODER_MAX_SIDE 1024 // Pixels, tiles are 256 or 512 wide
+#define TILE_DECODER_HEADER_SIZE 4 // uint16 width and height of raw RGB565 formats
+#define TILE_DECODER_RGB565_COLORS 65536
+#define LZ4_MIN_MATCH_LENGTH 4
+
+static uint16_t readUint16(const uint8_t *data) {
+  return uint16_t(data[0] | (data[1] << 8));
+}
+
+static void expandRgb565(uint16_t color, int32_t &red, int32_t &green, int32_t &blue) {
+  red = (color >> 11) & 0x1F;
+  green = (color >> 5) & 0x3F;
+  blue = color & 0x1F;
+  red = (red << 3) | (red >> 2);
+  green = (green << 2) | (green >> 4);
+  blue = (blue << 3) | (blue >> 2);
+}
+
+void indexRgb565Colors(const uint16_t *colors, size_t colorsCount, std::vector<uint8_t> &outIndices,
+                       Rgb565Palette &outPalette) {
+  // Reused by every tile decoded on the thread, counts are reset after use and lookup entries are always set
+  static thread_local std::vector<uint32_t> counts(TILE_DECODER_RGB565_COLORS, 0);
+  static thread_local std::vector<uint8_t> lookup(TILE_DECODER_RGB565_COLORS, 0);
+  static thread_local std::vector<std::pair<uint32_t, uint16_t>> usedColors; // Count and color
+
+  usedColors.clear();
+  for (size_t i = 0; i < colorsCount; i++) {
+    if (counts[colors[i]]++ == 0) {
+      usedColors.emplace_back(0, colors[i]);
+    }
+  }
+  for (auto &usedColor: usedColors) {
+    usedColor.first = counts[usedColor.second];
+    counts[usedColor.second] = 0;
+  }
+
+  outPalette.fill(0);
+  if (usedColors.size() <= outPalette.size()) {
+    // Every color gets its own palette entry
+    for (size_t i = 0; i < usedColors.size(); i++) {
+      outPalette[i] = usedColors[i].second;
+      lookup[usedColors[i].second] = uint8_t(i);
+    }
+  } else {
+    const size_t paletteSize = outPalette.size();
+    std::partial_sort(usedColors.begin(), usedColors.begin() + paletteSize, usedColors.end(),
+                      [](const std::pair<uint32_t, uint16_t> &a, const std::pair<uint32_t, uint16_t> &b) {
+                        return a.first > b.first;
+                      });
+    for (size_t i = 0; i < paletteSize; i++) {
+      outPalette[i] = usedColors[i].second;
+      lookup[usedColors[i].second] = uint8_t(i);
+    }
+    for (size_t i = paletteSize; i < usedColors.size(); i++) {
+      int32_t red, green, blue;
+      expandRgb565(usedColors[i].second, red, green, blue);
+      int32_t nearestDistance = INT32_MAX;
+      for (size_t j = 0; j < paletteSize; j++) {
+        int32_t paletteRed, paletteGreen, paletteBlue;
+        expandRgb565(outPalette[j], paletteRed, paletteGreen, paletteBlue);
+        const int32_t distance = (red - paletteRed) * (red - paletteRed) +
+                                 (green - paletteGreen) * (green - paletteGreen) +
+                                 (blue - paletteBlue) * (blue - paletteBlue);
+        if (distance < nearestDistance) {
+          nearestDistance = distance;
+          lookup[usedColors[i].second] = uint8_t(j);
+        }
+      }
+    }
+  }
+
+  outIndices.resize(colorsCount);
+  for (size_t i = 0; i < colorsCount; i++) {
+    outIndices[i] = lookup[colors[i]];
+  }
+}
+
+void indexRgbImage(const std::vector<uint8_t> &imageData, std::vector<uint8_t> &outIndices,
+                   Rgb565Palette &outPalette) {
+  std::vector<uint16_t> colors(imageData.size() / 3);
+  for (size_t i = 0; i < colors.size(); i++) {
+    const uint8_t *pixel = &imageData[i * 3];
+    colors[i] = uint16_t(((pixel[0] >> 3) << 11) | ((pixel[1] >> 2) << 5) | (pixel[2] >> 3));
+  }
+  indexRgb565Colors(colors.data(), colors.size(), outIndices, outPalette);
+}
+
+void expandRgb565Palette(const Rgb565Palette &palette, Rgb888Palette &outPalette) {
+  for (size_t i = 0; i < palette.size(); i++) {
+    int32_t red, green, blue;
+    expandRgb565(palette[i], red, green, blue);
+    outPalette[i * 3] = uint8_t(red);
+    outPalette[i * 3 + 1] = uint8_t(green);
+    outPalette[i * 3 + 2] = uint8_t(blue);
+  }
+}
+
+// Reads width and height of raw RGB565 formats, returns pixels count or 0 if the header is invalid
+static uint32_t readRawHeader(const uint8_t *data, uint32_t dataByteLength, uint16_t &width, uint16_t &height) {
+  if (dataByteLength < TILE_DECODER_HEADER_SIZE) {
+    return 0;
+  }
+  width = readUint16(data);
+  height = readUint16(data + 2);
+  if (width > TILE_DECODER_MAX_SIDE || height > TILE_DECODER_MAX_SIDE) {
+    return 0;
+  }
+  return uint32_t(width) * height;
+}
+
+// Reads LZ4 length extension bytes (each 255 continues), false if data ends first
+static bool readLz4Length(const uint8_t *&input, const uint8_t *inputEnd, uint32_t &length) {
+  uint8_t byte;
+  do {
+    if (input >= inputEnd) {
+      return false;
+    }
+    byte = *input++;
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+/**
+ * Decompresses an LZ4 block (no frame) of exactly outputByteLength bytes.
+ * Every length and offset is checked against both buffers.
+ * */
+static bool decompressLz4Block(uint8_t *output, uint32_t outputByteLength, const uint8_t *input,
+                               uint32_t inputByteLength) {
+  const uint8_t *inputEnd = input + inputByteLength;
+  uint8_t *outputPosition = output;
+  uint8_t *outputEnd = output + outputByteLength;
+
+  while (input < inputEnd) {
+    const uint8_t token = *input++;
+
+    uint32_t literalLength = token >> 4;
+    if (literalLength == 15 && !readLz4Length(input, inputEnd, literalLength)) {
+      return false;
+    }
+    if (literalLength > uint32_t(inputEnd - input) || literalLength > uint32_t(outputEnd - outputPosition)) {
+      return false;
+    }
+    memcpy(outputPosition, input, literalLength);
+    input += literalLength;
+    outputPosition += literalLength;
+
+    if (input == inputEnd) {
+      break; // Last sequence has literals only
+    }
+
+    if (inputEnd - input < 2) {
+      return false;
+    }
+    const uint32_t offset = readUint16(input);
+    input += 2;
+    if (offset == 0 || offset > uint32_t(outputPosition - output)) {
+      return false;
+    }
+
+    uint32_t matchLength = token & 0x0F;
+    if (matchLength == 15 && !readLz4Length(input, inputEnd, matchLength)) {
+      return false;
+    }
+    matchLength += LZ4_MIN_MATCH_LENGTH;
+    if (matchLength > uint32_t(outputEnd - outputPosition)) {
+      return false;
+    }
+    // Matches may overlap their own output, e.g. offset 2 repeats a single RGB565 color
+    const uint8_t *match = outputPosition - offset;
+    for (uint32_t i = 0; i < matchLength; i++) {
+      outputPosition[i] = match[i];
+    }
+    outputPosition += matchLength;
+  }
+
+  return outputPosition == outputEnd;
+}
+
+class PngTileDecoder : public TileDecoder {
+public:
+  const char *getFileExtension() const override {
+    return ".png";
+  }
+
+  std::pair<uint16_t, uint16_t> decode(std::vector<uint8_t> &outIndices, Rgb565Palette &outPalette,
+                                       const uint8_t *data, uint32_t dataByteLength) const override {
+    // Map tiles are mostly palette PNGs, which are kept as they are
+    auto tileResolution = parsePalettePngData(outIndices, outPalette, data, dataByteLength);
+    if (tileResolution.first != 0 && tileResolution.second != 0) {
+      return tileResolution;
+    }
+
+    std::vector<uint8_t> imageData;
+    tileResolution = parsePngData(imageData, data, dataByteLength);
+    indexRgbImage(imageData, outIndices, outPalette);
+    return tileResolution;
+  }
+};
+
+class RleRgb565TileDecoder : public TileDecoder {
+public:
+  const char *getFileExtension() const override {
+    return ".rle";
+  }
+
+  std::pair<uint16_t, uint16_t> decode(std::vector<uint8_t> &outIndices, Rgb565Palette &outPalette,
+                                       const uint8_t *data, uint32_t dataByteLength) const override {
+    uint16_t width, height;
+    const uint32_t pixelsCount = readRawHeader(data, dataByteLength, width, height);
+    std::vector<uint16_t> colors(pixelsCount);
+
+    uint32_t pixel = 0;
+    for (uint32_t offset = TILE_DECODER_HEADER_SIZE; offset + 3 <= dataByteLength && pixel < pixelsCount;
+         offset += 3) {
+      const uint32_t runLength = MIN(uint32_t(data[offset]) + 1, pixelsCount - pixel);
+      std::fill_n(colors.begin() + pixel, runLength, readUint16(data + offset + 1));
+      pixel += runLength;
+    }
+
+    if (pixelsCount == 0 || pixel < pixelsCount) {
+      std::cerr << "RLE tile data ends after " << pixel << " of " << pixelsCount << " pixels" << std::endl;
+      outIndices.clear();
+      return std::make_pair(0, 0);
+    }
+    indexRgb565Colors(colors.data(), colors.size(), outIndices, outPalette);
+    return std::make_pair(width, height);
+  }
+};
+
+class Lz4Rgb565TileDecoder : public TileDecoder {
+public:
+  const char *getFileExtension() const override {
+    return ".lz4";
+  }
+
+  std::pair<uint16_t, uint16_t> decode(std::vector<uint8_t> &outIndices, Rgb565Palette &outPalette,
+                                       const uint8_t *data, uint32_t dataByteLength) const override {
+    uint16_t width, height;
+    const uint32_t pixelsCount = readRawHeader(data, dataByteLength, width, height);
+    std::vector<uint8_t> colorBytes(size_t(pixelsCount) * 2);
+    if (pixelsCount == 0 ||
+        !decompressLz4Block(colorBytes.data(), uint32_t(colorBytes.size()), data + TILE_DECODER_HEADER_SIZE,
+                            dataByteLength - TILE_DECODER_HEADER_SIZE)) {
+      std::cerr << "Invalid LZ4 tile data of " << dataByteLength << " bytes" << std::endl;
+      outIndices.clear();
+      return std::make_pair(0, 0);
+    }
+
+    std::vector<uint16_t> colors(pixelsCount);
+    for (uint32_t i = 0; i < pixelsCount; i++) {
+      colors[i] = readUint16(&colorBytes[size_t(i) * 2]);
+    }
+    indexRgb565Colors(colors.data(), colors.size(), outIndices, outPalette);
+    return std::make_pair(width, height);
+  }
+};
+
+const TileDecoder *TileDecoder::forFormat(uint8_t format) {
+  static const PngTileDecoder pngDecoder;
+  static const RleRgb565TileDecoder rleRgb565Decoder;
+  static const Lz4Rgb565TileDecoder lz4Rgb565Decoder;
+
+  switch (format) {
+    case TILE_FORMAT_PNG:
+      return &pngDecoder;
+    case TILE_FORMAT_RLE_RGB565:
+      return &rleRgb565Decoder;
+    case TILE_FORMAT_LZ4_RGB565:
+      return &lz4Rgb565Decoder;
+    default:
+      return nullptr;
+  }
+}
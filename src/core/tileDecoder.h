@@ -0,0 +1,54 @@
+#ifndef BIKETOURASSISTANT_TILEDECODER_H
+#define BIKETOURASSISTANT_TILEDECODER_H
+
+#include "pngUtils.h"
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Format tag of SEND_MAP_TILE_START
+enum TileFormat {
+  TILE_FORMAT_PNG = 0, // Also read from start messages of phones not sending the tag
+  TILE_FORMAT_RLE_RGB565, // uint16 width, uint16 height, runs of (uint8 length - 1, uint16 color)
+  TILE_FORMAT_LZ4_RGB565, // uint16 width, uint16 height, LZ4 block of width * height uint16 colors
+  TILE_FORMATS_COUNT
+};
+
+/**
+ * Decoder of tile data received in one of TileFormat formats into palette-indexed tile images: one byte
+ * per texel indexing an RGB565 palette. Tiles are cached as received, in a file of the decoder's
+ * extension, and decoded the same way when loaded back.
+ * */
+class TileDecoder {
+public:
+  virtual ~TileDecoder() = default;
+
+  // Returns nullptr for unknown formats
+  static const TileDecoder *forFormat(uint8_t format);
+
+  virtual const char *getFileExtension() const = 0;
+
+  // Decodes data into texel indices of outPalette, returns tile width and height or 0, 0 on error
+  virtual std::pair<uint16_t, uint16_t> decode(std::vector<uint8_t> &outIndices, Rgb565Palette &outPalette,
+                                               const uint8_t *data, uint32_t dataByteLength) const = 0;
+};
+
+// 8-bit red, green and blue of each palette color, as interpolated by bilinear sampling
+typedef std::array<uint8_t, 256 * 3> Rgb888Palette;
+
+/**
+ * Builds the palette of given RGB565 colors and their indices. Images of more than 256 colors keep
+ * the 256 most frequent ones, any other color is replaced by the nearest of them.
+ * */
+void indexRgb565Colors(const uint16_t *colors, size_t colorsCount, std::vector<uint8_t> &outIndices,
+                       Rgb565Palette &outPalette);
+
+// Same for RGB888 image data
+void indexRgbImage(const std::vector<uint8_t> &imageData, std::vector<uint8_t> &outIndices,
+                   Rgb565Palette &outPalette);
+
+void expandRgb565Palette(const Rgb565Palette &palette, Rgb888Palette &outPalette);
+
+#endif //BIKETOURASSISTANT_TILEDECODER_H
@@ -4,10 +4,20 @@
 
 #include <tuple>
 #include <algorithm>
+#include <cmath>
+
+#define SIMPLIFICATION_TOLERANCE_PIXELS 1.0
+#define SIMPLIFICATION_MAX_LENGTH_TILES 1.0
+#define TILE_SIZE_PIXELS 256.0
+#define TOUR_STALLED_STREAM_TIMEOUT std::chrono::seconds(2) // Chunks of a streamed tour arrive milliseconds apart
 
 Tour::Tour() :
     zoom(0),
-    nearbyPointsCache({0, 0, 0, 0, std::vector<ClusteredPoint>()}) {
+    expectedPointsCount(0),
+    indexedPointsCount(0),
+    needSimplification(false),
+    indexZoom(0),
+    nearbyPointsCache({0, 0, 0, 0, std::vector<PointsRange>()}) {
   // noop
 }
 
@@ -18,103 +28,339 @@ Tour::~Tour() {
 
 void Tour::setZoom(uint8_t value) {
   this->zoom = value;
-
-  this->pointClusters.clear();
-  for (const auto &point: this->points) {
-    this->clusterPoint(point);
+  // Tour still streaming is indexed once it completes or stalls
+  if (this->indexedPointsCount > 0) {
+    this->buildIndex();
   }
 }
 
 void Tour::clear() {
   this->points.clear();
-  this->pointClusters.clear();
-  this->nearbyPointsCache.clusteredPoints.clear();
+  this->expectedPointsCount = 0;
+  this->indexedPointsCount = 0;
+  this->needSimplification = false;
+
+  std::lock_guard<std::mutex> lock(this->indexMutex);
+  this->clusteredPoints.pointIndices.clear();
+  this->clusteredPoints.tileX.clear();
+  this->clusteredPoints.tileY.clear();
+  this->clusteredPoints.nextPoint.clear();
+  this->cells.clear();
+  this->nearbyPointsCache.ranges.clear();
   this->nearbyPointsCache.tileRadius = 0; // invalidate cache
 }
 
-void Tour::clear(uint16_t expectedPointsCount) {
+void Tour::clear(uint32_t expectedPointsCount) {
   this->clear();
   this->points.reserve(expectedPointsCount);
+  this->expectedPointsCount = expectedPointsCount;
 }
 
-void Tour::pushPoint(uint16_t pointIndex, double latitude, double longitude) {
-  Point point = {pointIndex, latitude, longitude};
+void Tour::pushPoint(uint32_t pointIndex, double latitude, double longitude) {
+  if (this->expectedPointsCount > 0 && this->points.size() >= this->expectedPointsCount) {
+    std::cerr << "Tour point " << pointIndex << " exceeds expected points count" << std::endl;
+    return;
+  }
+
+  auto mercator = Tile::convertLatLongToMercator(latitude, longitude);
+  Point point = {pointIndex, mercator.first, mercator.second, 0};
   this->points.push_back(point);
-  this->clusterPoint(point);
+  this->needSimplification = true;
+  this->lastPointTime = std::chrono::steady_clock::now();
+
+  // While streaming a tour of known size the index is left untouched until the last point arrives,
+  // tours of unknown size are indexed once they stop arriving (see indexStalledPoints)
+  if (this->isComplete()) {
+    this->buildIndex();
+  }
+}
+
+bool Tour::isComplete() const {
+  return this->expectedPointsCount > 0 && this->points.size() >= this->expectedPointsCount;
+}
+
+bool Tour::indexStalledPoints() {
+  if (this->points.size() == this->indexedPointsCount ||
+      std::chrono::steady_clock::now() - this->lastPointTime < TOUR_STALLED_STREAM_TIMEOUT) {
+    return false;
+  }
+  this->buildIndex();
+  return true;
 }
 
 void Tour::resetPointsOfInterest(uint16_t pointsCount) {
+  std::lock_guard<std::mutex> lock(this->indexMutex);
   this->pointsOfInterest.clear();
   this->pointsOfInterest.reserve(pointsCount);
 }
 
 void Tour::pushPointOfInterest(double latitude, double longitude) {
-  PointOfInterest point = {latitude, longitude};
+  auto mercator = Tile::convertLatLongToMercator(latitude, longitude);
+  PointOfInterest point = {mercator.first, mercator.second};
+  std::lock_guard<std::mutex> lock(this->indexMutex);
   this->pointsOfInterest.push_back(point);
 }
 
 bool Tour::empty() const {
-  return this->points.empty() && this->pointsOfInterest.empty();
+  std::lock_guard<std::mutex> lock(this->indexMutex);
+  return this->clusteredPoints.size() == 0 && this->pointsOfInterest.empty();
 }
 
-void Tour::clusterPoint(Tour::Point point) {
-  if (this->zoom == 0) {
-    return;
+uint64_t Tour::getCellId(uint32_t tileX, uint32_t tileY, uint8_t zoom) {
+  // Row-major order, so cells of a single row of the neighbourhood are contiguous
+  return (uint64_t(tileY) << zoom) + uint64_t(tileX);
+}
+
+void Tour::simplifyPoints() {
+  this->needSimplification = false;
+
+  auto compareIndex = [](const Point &a, const Point &b) {
+    return a.pointIndex < b.pointIndex;
+  };
+  if (!std::is_sorted(this->points.begin(), this->points.end(), compareIndex)) {
+    std::sort(this->points.begin(), this->points.end(), compareIndex);
+  }
+
+  // Douglas-Peucker run once over the whole tour. Instead of using a fixed tolerance, every vertex records the lowest
+  // zoom level at which it has to be drawn, so simplified route for any zoom is just a filter over the points.
+  struct Span {
+    uint32_t first;
+    uint32_t last;
+    uint8_t minZoom;
+  };
+  std::vector<Span> stack;
+
+  const auto pointsCount = uint32_t(this->points.size());
+  uint32_t segmentStart = 0;
+  for (uint32_t i = 1; i <= pointsCount; i++) {
+    if (i < pointsCount && this->points[i - 1].pointIndex + 1 == this->points[i].pointIndex) {
+      continue;
+    }
+
+    // Segment endpoints are always drawn
+    this->points[segmentStart].minZoom = 0;
+    this->points[i - 1].minZoom = 0;
+    if (i - 1 > segmentStart) {
+      stack.push_back({segmentStart, i - 1, 0});
+    }
+
+    while (!stack.empty()) {
+      Span span = stack.back();
+      stack.pop_back();
+      if (span.last - span.first < 2) {
+        continue;
+      }
+
+      const Point &first = this->points[span.first];
+      const Point &last = this->points[span.last];
+      uint32_t farthest = span.first;
+      double farthestDistance = -1.0;
+      for (uint32_t j = span.first + 1; j < span.last; j++) {
+        double distance = distanceToLineSegment(this->points[j].mercatorX, this->points[j].mercatorY,
+                                                first.mercatorX, first.mercatorY, last.mercatorX, last.mercatorY);
+        if (distance > farthestDistance) {
+          farthestDistance = distance;
+          farthest = j;
+        }
+      }
+
+      if (farthest == span.first) {
+        continue; // No comparable distance (non-finite coordinates), splitting would not make progress
+      }
+
+      double length = std::hypot(last.mercatorX - first.mercatorX, last.mercatorY - first.mercatorY);
+      // A vertex cannot show up before the split that exposed it
+      uint8_t minZoom = std::max(span.minZoom, std::min(getMinimalZoom(farthestDistance), getMaximalLengthZoom(length)));
+      this->points[farthest].minZoom = minZoom;
+      stack.push_back({span.first, farthest, minZoom});
+      stack.push_back({farthest, span.last, minZoom});
+    }
+
+    segmentStart = i;
   }
-  auto tileXY = Tile::convertLatLongToTileXY(point.latitude, point.longitude, this->zoom);
-  auto tileKey = Tile::getTileKey(uint32_t(std::get<0>(tileXY)), uint32_t(std::get<1>(tileXY)), this->zoom);
+}
+
+uint8_t Tour::getMinimalZoom(double distance) {
+  // Vertex is drawn at zoom z when its distance is not lower than tolerance expressed in normalized Mercator units:
+  // SIMPLIFICATION_TOLERANCE_PIXELS / (TILE_SIZE_PIXELS * 2^z)
+  if (distance <= 0.0) {
+    return UINT8_MAX;
+  }
+  return clampZoom(std::ceil(std::log2(SIMPLIFICATION_TOLERANCE_PIXELS / (TILE_SIZE_PIXELS * distance))));
+}
+
+uint8_t Tour::getMaximalLengthZoom(double length) {
+  // Simplified lines are kept shorter than SIMPLIFICATION_MAX_LENGTH_TILES so that any line crossing the map view
+  // has its starting point within the neighbourhood returned by getNearbyPoints
+  if (length <= 0.0) {
+    return UINT8_MAX;
+  }
+  return clampZoom(std::floor(std::log2(SIMPLIFICATION_MAX_LENGTH_TILES / length)) + 1.0);
+}
+
+uint8_t Tour::clampZoom(double zoom) {
+  if (zoom <= 0.0) {
+    return 0;
+  }
+  return zoom >= double(UINT8_MAX) ? UINT8_MAX : uint8_t(zoom);
+}
+
+double Tour::distanceToLineSegment(double x, double y, double startX, double startY, double endX, double endY) {
+  const double dx = endX - startX;
+  const double dy = endY - startY;
+  const double lengthSquared = dx * dx + dy * dy;
 
-  if (this->pointClusters.find(tileKey) == this->pointClusters.end()) {
-    this->pointClusters[tileKey] = std::vector<ClusteredPoint>();
+  double t = 0.0;
+  if (lengthSquared > 0.0) {
+    t = std::max(0.0, std::min(1.0, ((x - startX) * dx + (y - startY) * dy) / lengthSquared));
   }
-  this->pointClusters[tileKey].push_back({point.pointIndex,
-                                          point.latitude, point.longitude,
-                                          std::get<0>(tileXY), std::get<1>(tileXY)
-                                         });
 
+  return std::hypot(x - (startX + t * dx), y - (startY + t * dy));
+}
+
+void Tour::buildIndex() {
+  this->indexedPointsCount = this->points.size();
+  if (this->needSimplification) {
+    this->simplifyPoints();
+  }
+
+  // Built aside so the display thread keeps drawing the previous index meanwhile, which is freed after the swap
+  ClusteredPoints clusteredPoints;
+  std::vector<Cell> cells;
+  this->clusterPoints(clusteredPoints, cells);
+
+  std::lock_guard<std::mutex> lock(this->indexMutex);
+  std::swap(this->clusteredPoints, clusteredPoints);
+  std::swap(this->cells, cells);
+  this->indexZoom = this->zoom;
   this->nearbyPointsCache.tileRadius = 0; // invalidate cache
 }
 
-std::vector<Tour::ClusteredPoint> &Tour::getNearbyPoints(double latitude, double longitude, uint8_t tileRadius) {
-  auto centerTileXY = Tile::convertLatLongToTileXY(latitude, longitude, this->zoom);
+void Tour::clusterPoints(ClusteredPoints &clusteredPoints, std::vector<Cell> &cells) const {
+  // Only vertices of the route simplified for current zoom level are indexed
+  std::vector<uint32_t> visible;
+  if (this->zoom > 0) {
+    visible.reserve(this->points.size());
+    for (uint32_t i = 0; i < this->points.size(); i++) {
+      if (this->points[i].minZoom <= this->zoom) {
+        visible.push_back(i);
+      }
+    }
+  }
+
+  const size_t pointsCount = visible.size();
+  clusteredPoints.pointIndices.resize(pointsCount);
+  clusteredPoints.tileX.resize(pointsCount);
+  clusteredPoints.tileY.resize(pointsCount);
+  clusteredPoints.nextPoint.assign(pointsCount, TOUR_NO_POINT);
+  cells.clear();
+
+  if (pointsCount == 0) {
+    return;
+  }
+
+  std::vector<std::pair<double, double>> tileXY(pointsCount);
+  std::vector<uint64_t> cellIds(pointsCount);
+  for (size_t i = 0; i < pointsCount; i++) {
+    const Point &point = this->points[visible[i]];
+    tileXY[i] = Tile::convertMercatorToTileXY(point.mercatorX, point.mercatorY, this->zoom);
+    cellIds[i] = getCellId(uint32_t(tileXY[i].first), uint32_t(tileXY[i].second), this->zoom);
+  }
+
+  // Order of visible points sorted by cell and then by point index (visible points are already sorted by index)
+  std::vector<uint32_t> order(pointsCount);
+  for (uint32_t i = 0; i < pointsCount; i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return cellIds[a] < cellIds[b];
+  });
+
+  std::vector<uint32_t> clusteredPosition(pointsCount);
+  for (uint32_t position = 0; position < pointsCount; position++) {
+    uint32_t i = order[position];
+    clusteredPosition[i] = position;
+
+    clusteredPoints.pointIndices[position] = this->points[visible[i]].pointIndex;
+    clusteredPoints.tileX[position] = tileXY[i].first;
+    clusteredPoints.tileY[position] = tileXY[i].second;
+
+    if (cells.empty() || cells.back().cellId != cellIds[i]) {
+      cells.push_back({cellIds[i], position});
+    }
+  }
+
+  // Link adjacent visible points (prevents from connecting two separate segments of the tour).
+  // Within a segment point indices are consecutive, so skipped vertices never make up an index gap.
+  for (size_t i = 1; i < pointsCount; i++) {
+    uint32_t previous = visible[i - 1];
+    uint32_t current = visible[i];
+    if (this->points[current].pointIndex - this->points[previous].pointIndex == current - previous) {
+      clusteredPoints.nextPoint[clusteredPosition[i - 1]] = clusteredPosition[i];
+    }
+  }
+
+  DEBUG("Clustered %zu of %zu tour points into %zu cells\n", pointsCount, this->points.size(), cells.size());
+}
+
+const std::vector<Tour::PointsRange> &
+Tour::getNearbyPoints(double latitude, double longitude, uint8_t tileRadius) {
+  auto centerTileXY = Tile::convertLatLongToTileXY(latitude, longitude, this->indexZoom);
 
   if (this->nearbyPointsCache.centerTileX == uint32_t(std::get<0>(centerTileXY)) &&
       this->nearbyPointsCache.centerTileY == uint32_t(std::get<1>(centerTileXY)) &&
       this->nearbyPointsCache.tileRadius == tileRadius &&
-      this->nearbyPointsCache.zoom == this->zoom) {
-    return this->nearbyPointsCache.clusteredPoints;
+      this->nearbyPointsCache.zoom == this->indexZoom) {
+    return this->nearbyPointsCache.ranges;
   }
 
-  DEBUG("Recalculating nearby points cache. Total tour length: %zu\n", this->points.size());
-
   this->nearbyPointsCache.centerTileX = uint32_t(std::get<0>(centerTileXY));
   this->nearbyPointsCache.centerTileY = uint32_t(std::get<1>(centerTileXY));
   this->nearbyPointsCache.tileRadius = tileRadius;
-  this->nearbyPointsCache.zoom = this->zoom;
-  this->nearbyPointsCache.clusteredPoints.clear();
-
-  for (int x = -tileRadius; x <= tileRadius; x++) {
-    for (int y = -tileRadius; y <= tileRadius; y++) {
-      auto tileKey = Tile::getTileKey(
-          this->nearbyPointsCache.centerTileX + x, this->nearbyPointsCache.centerTileY + y,
-          this->zoom);
-      if (this->pointClusters.find(tileKey) != this->pointClusters.end()) {
-        std::vector<Tour::ClusteredPoint> &tilePoints = this->pointClusters[tileKey];
-        for (auto &point: tilePoints) {
-          this->nearbyPointsCache.clusteredPoints.push_back(point);
-        }
-      }
+  this->nearbyPointsCache.zoom = this->indexZoom;
+  this->nearbyPointsCache.ranges.clear();
+
+  if (this->cells.empty()) {
+    return this->nearbyPointsCache.ranges;
+  }
+
+  const int64_t tilesCount = int64_t(1) << this->indexZoom;
+  const int64_t centerX = this->nearbyPointsCache.centerTileX;
+  const int64_t centerY = this->nearbyPointsCache.centerTileY;
+  const int64_t minX = std::max(centerX - tileRadius, int64_t(0));
+  const int64_t maxX = std::min(centerX + tileRadius, tilesCount - 1);
+
+  auto compareCell = [](const Cell &cell, uint64_t cellId) {
+    return cell.cellId < cellId;
+  };
+
+  // Each row of the neighbourhood maps to a single contiguous range of clustered points
+  for (int64_t y = centerY - tileRadius; y <= centerY + tileRadius; y++) {
+    if (y < 0 || y >= tilesCount || minX > maxX) {
+      continue;
     }
+
+    auto first = std::lower_bound(this->cells.begin(), this->cells.end(),
+                                  getCellId(uint32_t(minX), uint32_t(y), this->indexZoom), compareCell);
+    auto last = std::lower_bound(first, this->cells.end(),
+                                 getCellId(uint32_t(maxX), uint32_t(y), this->indexZoom) + 1, compareCell);
+    if (first == last) {
+      continue;
+    }
+
+    uint32_t end = last == this->cells.end() ? uint32_t(this->clusteredPoints.size()) : last->begin;
+    this->nearbyPointsCache.ranges.push_back({first->begin, end});
   }
 
-  std::sort(
-      this->nearbyPointsCache.clusteredPoints.begin(),
-      this->nearbyPointsCache.clusteredPoints.end(),
-      [](const Tour::ClusteredPoint &a, const Tour::ClusteredPoint &b) {
-        return a.pointIndex < b.pointIndex;
-      }
-  );
-  return this->nearbyPointsCache.clusteredPoints;
+  return this->nearbyPointsCache.ranges;
+}
+
+std::unique_lock<std::mutex> Tour::lockIndex() const {
+  return std::unique_lock<std::mutex>(this->indexMutex);
+}
+
+const Tour::ClusteredPoints &Tour::getClusteredPoints() const {
+  return this->clusteredPoints;
 }
 
 const std::vector<Tour::PointOfInterest> &Tour::getPointsOfInterest() const {
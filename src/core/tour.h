@@ -1,48 +1,89 @@
 #ifndef BIKETOURASSISTANT_TOUR_H
 #define BIKETOURASSISTANT_TOUR_H
 
+#include <chrono>
 #include <cstdint>
 #include <iostream>
 #include <vector>
 #include <map>
+#include <mutex>
+
+#define TOUR_NO_POINT UINT32_MAX
 
 class Tour {
 public:
+  // Points are projected once on arrival and kept in normalized Mercator coordinates (see Tile::convertLatLongToMercator)
   struct PointOfInterest {
-    double latitude;
-    double longitude;
+    double mercatorX;
+    double mercatorY;
   };
   struct Point {
-    uint16_t pointIndex;
-    double latitude;
-    double longitude;
+    uint32_t pointIndex;
+    double mercatorX;
+    double mercatorY;
+    uint8_t minZoom; // Lowest zoom level at which the point survives route simplification
+  };
+  /**
+   * Structure of arrays holding tour points visible at current zoom level, sorted by the tile (cell) containing it and then by point index.
+   * All vectors have the same length. Positions are shared across vectors.
+   * */
+  struct ClusteredPoints {
+    std::vector<uint32_t> pointIndices;
+    std::vector<double> tileX;
+    std::vector<double> tileY;
+    // Position of the adjacent following point (pointIndex + 1) or TOUR_NO_POINT if there is none
+    std::vector<uint32_t> nextPoint;
+
+    size_t size() const {
+      return this->pointIndices.size();
+    }
   };
-  struct ClusteredPoint {
-    uint16_t pointIndex;
-    double latitude;
-    double longitude;
-    double tileX;
-    double tileY;
+  struct Cell {
+    uint64_t cellId;
+    uint32_t begin; // Position of the first point in ClusteredPoints; cell ends where the next one begins
+  };
+  // Half-open range of positions in ClusteredPoints
+  struct PointsRange {
+    uint32_t begin;
+    uint32_t end;
   };
   struct PointsCache {
     uint32_t centerTileX;
     uint32_t centerTileY;
     uint8_t tileRadius;
     uint8_t zoom;
-    std::vector<ClusteredPoint> clusteredPoints;
+    std::vector<PointsRange> ranges;
   };
 
   Tour();
 
   ~Tour();
 
+  /**
+   * Points are received and indexed by the bluetooth thread, which is the only one to call the methods changing
+   * the tour. The index is built aside and swapped in under the index lock, see lockIndex.
+   * */
   void setZoom(uint8_t zoom);
 
   void clear();
 
-  void clear(uint16_t expectedPointsCount);
+  /**
+   * Starts streaming a tour of known size. Points buffer is preallocated up front and the spatial index
+   * is built once, when the last expected point is pushed.
+   * */
+  void clear(uint32_t expectedPointsCount);
+
+  void pushPoint(uint32_t pointIndex, double latitude, double longitude);
 
-  void pushPoint(uint16_t pointIndex, double latitude, double longitude);
+  // True when every point announced by clear(expectedPointsCount) has been received
+  bool isComplete() const;
+
+  /**
+   * Indexes the points received so far when none arrived for TOUR_STALLED_STREAM_TIMEOUT, so a tour that never
+   * completes (e.g. a chunk was lost or its size was not announced) is drawn as received. Returns true if the
+   * index changed.
+   * */
+  bool indexStalledPoints();
 
   void resetPointsOfInterest(uint16_t pointsCount);
 
@@ -50,22 +91,57 @@ public:
 
   bool empty() const;
 
-  std::vector<ClusteredPoint> &getNearbyPoints(double latitude, double longitude, uint8_t tileRadius);
+  /**
+   * Returns ranges of clustered points lying within tileRadius tiles around given location.
+   * Ranges point into getClusteredPoints() and stay valid while the index lock is held.
+   * */
+  const std::vector<PointsRange> &getNearbyPoints(double latitude, double longitude, uint8_t tileRadius);
+
+  const ClusteredPoints &getClusteredPoints() const;
+
+  /**
+   * Tour is changed by the bluetooth thread while the display thread draws it. Clustered points, nearby ranges
+   * and points of interest are only to be read while holding the returned lock.
+   * */
+  std::unique_lock<std::mutex> lockIndex() const;
 
 private:
+  // Received by the bluetooth thread
   uint8_t zoom;
-
   std::vector<Point> points;
-  std::map<std::string, std::vector<ClusteredPoint>> pointClusters;
+  uint32_t expectedPointsCount;
+  size_t indexedPointsCount; // Points received when the index was built
+  std::chrono::steady_clock::time_point lastPointTime;
+  bool needSimplification;
+
+  // Index read by the display thread, guarded by indexMutex
+  mutable std::mutex indexMutex;
+  uint8_t indexZoom;
+  ClusteredPoints clusteredPoints;
+  std::vector<Cell> cells;
   PointsCache nearbyPointsCache;
-
   std::vector<PointOfInterest> pointsOfInterest;
 public:
   const std::vector<PointOfInterest> &getPointsOfInterest() const;
 
 private:
 
-  void clusterPoint(Point point);
+  void simplifyPoints();
+
+  // Simplifies and clusters received points for current zoom, then publishes them as the index
+  void buildIndex();
+
+  void clusterPoints(ClusteredPoints &clusteredPoints, std::vector<Cell> &cells) const;
+
+  static uint8_t getMinimalZoom(double distance);
+
+  static uint8_t getMaximalLengthZoom(double length);
+
+  static uint8_t clampZoom(double zoom);
+
+  static double distanceToLineSegment(double x, double y, double startX, double startY, double endX, double endY);
+
+  static uint64_t getCellId(uint32_t tileX, uint32_t tileY, uint8_t zoom);
 };
 
 
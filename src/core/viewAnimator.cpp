@@ -0,0 +1,121 @@
+#include "viewAnimator.h"
+#include "tile.h"
+
+#include <cmath>
+
+#define VIEW_FRAME_INTERVAL 33 // milliseconds, about 30 frames per second
+#define VIEW_HEADING_TIME_CONSTANT 400.0 // milliseconds
+#define VIEW_POSITION_TIME_CONSTANT 300.0 // milliseconds
+// Smallest changes worth a frame. Heading changes resample the whole map, position changes only shift it.
+#define VIEW_HEADING_THRESHOLD 2.0 // degrees
+#define VIEW_POSITION_THRESHOLD 1.0 // pixels
+// Targets this far away are jumped to, e.g. after a GPS outage
+#define VIEW_SNAP_DISTANCE (MAP_WIDTH / 2) // pixels
+#define VIEW_TILE_SIZE 256 // pixels
+
+// Difference of two headings in the range from -180 to 180 degrees
+static double headingDifference(double from, double to) {
+  double difference = std::fmod(to - from, 360.0);
+  if (difference > 180.0) {
+    difference -= 360.0;
+  } else if (difference <= -180.0) {
+    difference += 360.0;
+  }
+  return difference;
+}
+
+static double normalizeHeading(double heading) {
+  heading = std::fmod(heading, 360.0);
+  return heading < 0 ? heading + 360.0 : heading;
+}
+
+// Distance of two locations in map pixels
+static double pixelDistance(double latitudeA, double longitudeA, double latitudeB, double longitudeB, uint8_t zoom) {
+  auto a = Tile::convertLatLongToTileXY(latitudeA, longitudeA, zoom);
+  auto b = Tile::convertLatLongToTileXY(latitudeB, longitudeB, zoom);
+  return std::hypot(a.first - b.first, a.second - b.second) * VIEW_TILE_SIZE;
+}
+
+ViewAnimator::ViewAnimator() :
+    hasTarget(false), isSnapping(true),
+    targetLatitude(0), targetLongitude(0), targetHeading(0), mapZoom(0),
+    latitude(0), longitude(0), heading(0),
+    drawnLatitude(0), drawnLongitude(0), drawnHeading(0) {
+  // noop
+}
+
+void ViewAnimator::setTarget(double latitude, double longitude, double heading, uint8_t mapZoom) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (mapZoom != this->mapZoom) {
+    this->isSnapping = true;
+  }
+  this->targetLatitude = latitude;
+  this->targetLongitude = longitude;
+  this->targetHeading = normalizeHeading(heading);
+  this->mapZoom = mapZoom;
+  this->hasTarget = true;
+}
+
+void ViewAnimator::reset() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->isSnapping = true;
+}
+
+uint8_t ViewAnimator::update(steadyTimestamp now) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (!this->hasTarget) {
+    return VIEW_CHANGED_NONE;
+  }
+
+  if (this->isSnapping || pixelDistance(this->latitude, this->longitude, this->targetLatitude,
+                                        this->targetLongitude, this->mapZoom) > VIEW_SNAP_DISTANCE) {
+    this->isSnapping = false;
+    this->latitude = this->drawnLatitude = this->targetLatitude;
+    this->longitude = this->drawnLongitude = this->targetLongitude;
+    this->heading = this->drawnHeading = this->targetHeading;
+    this->lastUpdateTime = this->lastFrameTime = now;
+    return VIEW_CHANGED_POSITION | VIEW_CHANGED_HEADING;
+  }
+
+  // Exponential smoothing independent of the update rate
+  const double elapsed = std::chrono::duration<double, std::milli>(now - this->lastUpdateTime).count();
+  this->lastUpdateTime = now;
+  const double headingFactor = 1.0 - std::exp(-elapsed / VIEW_HEADING_TIME_CONSTANT);
+  const double positionFactor = 1.0 - std::exp(-elapsed / VIEW_POSITION_TIME_CONSTANT);
+  this->heading = normalizeHeading(
+      this->heading + headingDifference(this->heading, this->targetHeading) * headingFactor
+  );
+  this->latitude += (this->targetLatitude - this->latitude) * positionFactor;
+  this->longitude += (this->targetLongitude - this->longitude) * positionFactor;
+
+  if (now - this->lastFrameTime < std::chrono::milliseconds(VIEW_FRAME_INTERVAL)) {
+    return VIEW_CHANGED_NONE;
+  }
+
+  uint8_t changes = VIEW_CHANGED_NONE;
+  if (std::fabs(headingDifference(this->drawnHeading, this->heading)) >= VIEW_HEADING_THRESHOLD) {
+    this->drawnHeading = this->heading;
+    changes |= VIEW_CHANGED_HEADING;
+  }
+  if (pixelDistance(this->drawnLatitude, this->drawnLongitude, this->latitude, this->longitude,
+                    this->mapZoom) >= VIEW_POSITION_THRESHOLD) {
+    this->drawnLatitude = this->latitude;
+    this->drawnLongitude = this->longitude;
+    changes |= VIEW_CHANGED_POSITION;
+  }
+  if (changes != VIEW_CHANGED_NONE) {
+    this->lastFrameTime = now;
+  }
+  return changes;
+}
+
+Location ViewAnimator::apply(const Location &location) const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  Location view = location;
+  if (this->hasTarget) {
+    view.latitude = this->drawnLatitude;
+    view.longitude = this->drawnLongitude;
+    view.heading = this->drawnHeading;
+  }
+  return view;
+}
@@ -0,0 +1,63 @@
+#ifndef BIKETOURASSISTANT_VIEWANIMATOR_H
+#define BIKETOURASSISTANT_VIEWANIMATOR_H
+
+#include "common.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+using steadyTimestamp = std::chrono::steady_clock::time_point;
+
+enum ViewChange {
+  VIEW_CHANGED_NONE = 0,
+  VIEW_CHANGED_POSITION = 1,
+  VIEW_CHANGED_HEADING = 2,
+};
+
+/**
+ * Heading and position shown on the map. Location updates only set the target, which the view follows
+ * with exponential smoothing at a fixed frame rate. A frame is requested once the view moved perceptibly
+ * since the drawn one, so heading wobble does not repaint the map and turns are drawn in small steps.
+ * */
+class ViewAnimator {
+public:
+  ViewAnimator();
+
+  // Sets location to follow, called on location updates
+  void setTarget(double latitude, double longitude, double heading, uint8_t mapZoom);
+
+  // Next target is shown right away, without animation
+  void reset();
+
+  /**
+   * Advances the view to given time, called from the drawing loop.
+   * Returns combination of ViewChange flags telling what to redraw.
+   * */
+  uint8_t update(steadyTimestamp now);
+
+  // Returns copy of the location with the drawn view position and heading
+  Location apply(const Location &location) const;
+
+private:
+  mutable std::mutex mutex;
+  bool hasTarget;
+  bool isSnapping;
+  double targetLatitude;
+  double targetLongitude;
+  double targetHeading;
+  uint8_t mapZoom;
+
+  // Smoothed view and the view drawn last, which apply() returns
+  double latitude;
+  double longitude;
+  double heading;
+  double drawnLatitude;
+  double drawnLongitude;
+  double drawnHeading;
+
+  steadyTimestamp lastUpdateTime;
+  steadyTimestamp lastFrameTime;
+};
+
+#endif //BIKETOURASSISTANT_VIEWANIMATOR_H
@@ -0,0 +1,102 @@
+#include "workerPool.h"
+
+WorkerPool::WorkerPool(uint8_t workerCount) :
+    task(nullptr), taskCount(0), nextTaskIndex(0), finishedTaskCount(0), activeWorkerCount(0),
+    generation(0), isStopping(false) {
+  this->workers.reserve(workerCount);
+  for (uint8_t i = 0; i < workerCount; i++) {
+    this->workers.emplace_back(&WorkerPool::workerLoop, this);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->isStopping = true;
+  }
+  this->tasksAvailable.notify_all();
+  for (auto &worker: this->workers) {
+    worker.join();
+  }
+}
+
+void WorkerPool::run(uint16_t taskCount, const std::function<void(uint16_t)> &task) {
+  if (this->workers.empty() || taskCount <= 1) {
+    for (uint16_t i = 0; i < taskCount; i++) {
+      task(i);
+    }
+    return;
+  }
+
+  {
+    // Workers woken late for the previous run must leave before its state is replaced
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->tasksFinished.wait(lock, [this] {
+      return this->activeWorkerCount == 0;
+    });
+    this->task = &task;
+    this->taskCount = taskCount;
+    this->nextTaskIndex = 0;
+    this->finishedTaskCount = 0;
+    this->generation++;
+  }
+  this->tasksAvailable.notify_all();
+
+  this->runTasks();
+
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->tasksFinished.wait(lock, [this] {
+    return this->finishedTaskCount == this->taskCount && this->activeWorkerCount == 0;
+  });
+  this->task = nullptr;
+}
+
+uint8_t WorkerPool::getThreadCount() const {
+  return uint8_t(this->workers.size() + 1);
+}
+
+void WorkerPool::workerLoop() {
+  uint32_t seenGeneration = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->tasksAvailable.wait(lock, [this, seenGeneration] {
+        return this->isStopping || this->generation != seenGeneration;
+      });
+      if (this->isStopping) {
+        return;
+      }
+      seenGeneration = this->generation;
+      this->activeWorkerCount++;
+    }
+
+    this->runTasks();
+
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->activeWorkerCount--;
+    }
+    this->tasksFinished.notify_all();
+  }
+}
+
+void WorkerPool::runTasks() {
+  while (true) {
+    const uint16_t index = this->nextTaskIndex++;
+    if (index >= this->taskCount) {
+      return;
+    }
+
+    (*this->task)(index);
+
+    bool isLast;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      isLast = ++this->finishedTaskCount == this->taskCount;
+    }
+    if (isLast) {
+      this->tasksFinished.notify_all();
+    }
+  }
+}
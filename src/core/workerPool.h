@@ -0,0 +1,48 @@
+#ifndef BIKETOURASSISTANT_WORKERPOOL_H
+#define BIKETOURASSISTANT_WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of threads, started once, which split indexed tasks (e.g. bands of a frame) with the calling thread.
+ * Tasks are claimed one by one, so uneven tasks are balanced among threads.
+ * */
+class WorkerPool {
+public:
+  explicit WorkerPool(uint8_t workerCount);
+
+  ~WorkerPool();
+
+  // Calls task for each index from 0 to taskCount - 1 and returns once all of them finished
+  void run(uint16_t taskCount, const std::function<void(uint16_t)> &task);
+
+  // Workers and the calling thread
+  uint8_t getThreadCount() const;
+
+private:
+  void workerLoop();
+
+  void runTasks();
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable tasksAvailable;
+  std::condition_variable tasksFinished;
+
+  // State of the current run, changed under the mutex while no worker is active
+  const std::function<void(uint16_t)> *task;
+  uint16_t taskCount;
+  std::atomic<uint16_t> nextTaskIndex;
+  uint16_t finishedTaskCount;
+  uint8_t activeWorkerCount;
+  uint32_t generation;
+  bool isStopping;
+};
+
+#endif //BIKETOURASSISTANT_WORKERPOOL_H
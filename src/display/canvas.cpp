@@ -0,0 +1,262 @@
+#include "canvas.h"
+
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+
+Canvas::Canvas(uint16_t *buffer, uint16_t width, uint16_t height, uint16_t stride, uint16_t rotate, uint8_t mirror) {
+  // Memory coordinates as linear functions of logical ones: X = ax * x + bx * y + cx, Y = ay * x + by * y + cy
+  int32_t ax = 1, bx = 0, cx = 0;
+  int32_t ay = 0, by = 1, cy = 0;
+  switch (rotate) {
+    case ROTATE_90:
+      ax = 0, bx = -1, cx = width - 1;
+      ay = 1, by = 0, cy = 0;
+      break;
+    case ROTATE_180:
+      ax = -1, bx = 0, cx = width - 1;
+      ay = 0, by = -1, cy = height - 1;
+      break;
+    case ROTATE_270:
+      ax = 0, bx = 1, cx = 0;
+      ay = -1, by = 0, cy = height - 1;
+      break;
+    default:
+      break;
+  }
+  if (mirror & MIRROR_HORIZONTAL) {
+    ax = -ax, bx = -bx, cx = width - 1 - cx;
+  }
+  if (mirror & MIRROR_VERTICAL) {
+    ay = -ay, by = -by, cy = height - 1 - cy;
+  }
+
+  const bool swapAxes = rotate == ROTATE_90 || rotate == ROTATE_270;
+  this->width = swapAxes ? height : width;
+  this->height = swapAxes ? width : height;
+  this->origin = buffer + ptrdiff_t(cy) * stride + cx;
+  this->stepX = ptrdiff_t(ay) * stride + ax;
+  this->stepY = ptrdiff_t(by) * stride + bx;
+}
+
+uint16_t Canvas::getWidth() const {
+  return this->width;
+}
+
+uint16_t Canvas::getHeight() const {
+  return this->height;
+}
+
+void Canvas::clear(uint16_t color) {
+  for (int32_t y = 0; y < this->height; y++) {
+    this->fillSpan(0, this->width - 1, y, color);
+  }
+}
+
+void Canvas::setPixel(int32_t x, int32_t y, uint16_t color) {
+  if (x < 0 || y < 0 || x >= this->width || y >= this->height) {
+    return;
+  }
+  *this->pixelAddress(x, y) = swapBytes(color);
+}
+
+void Canvas::fillSpan(int32_t x0, int32_t x1, int32_t y, uint16_t color) {
+  if (y < 0 || y >= this->height) {
+    return;
+  }
+  x0 = std::max(x0, int32_t(0));
+  x1 = std::min(x1, int32_t(this->width) - 1);
+  if (x0 > x1) {
+    return;
+  }
+
+  const size_t count = size_t(x1 - x0 + 1);
+  const uint16_t value = swapBytes(color);
+  if (this->stepX == 1) {
+    std::fill_n(this->pixelAddress(x0, y), count, value);
+  } else if (this->stepX == -1) {
+    std::fill_n(this->pixelAddress(x1, y), count, value);
+  } else {
+    // Rows of a canvas rotated by 90 or 270 degrees run across memory rows
+    uint16_t *pixel = this->pixelAddress(x0, y);
+    for (size_t i = 0; i < count; i++, pixel += this->stepX) {
+      *pixel = value;
+    }
+  }
+}
+
+void Canvas::copySpan(int32_t x, int32_t y, const uint16_t *pixels, int32_t count) {
+  if (y < 0 || y >= this->height) {
+    return;
+  }
+  if (x < 0) {
+    pixels -= x;
+    count += x;
+    x = 0;
+  }
+  count = std::min(count, int32_t(this->width) - x);
+  if (count <= 0) {
+    return;
+  }
+
+  uint16_t *target = this->pixelAddress(x, y);
+  if (this->stepX == 1) {
+    std::copy(pixels, pixels + count, target);
+  } else if (this->stepX == -1) {
+    std::reverse_copy(pixels, pixels + count, target - (count - 1));
+  } else {
+    for (int32_t i = 0; i < count; i++, target += this->stepX) {
+      *target = pixels[i];
+    }
+  }
+}
+
+void Canvas::copyImage(int32_t x, int32_t y, const uint16_t *image, uint16_t width, uint16_t height) {
+  // Steps of the image follow the canvas ones, with the image's own row length
+  const bool rowMajor = this->stepX == 1 || this->stepX == -1;
+  const ptrdiff_t imageStepX = rowMajor ? this->stepX : (this->stepX > 0 ? height : -ptrdiff_t(height));
+  const ptrdiff_t imageStepY = rowMajor ? (this->stepY > 0 ? width : -ptrdiff_t(width)) : (this->stepY > 0 ? 1 : -1);
+  const uint16_t *imageOrigin = image +
+                                (imageStepX < 0 ? -imageStepX * (width - 1) : 0) +
+                                (imageStepY < 0 ? -imageStepY * (height - 1) : 0);
+
+  const int32_t firstColumn = std::max(int32_t(0), -x);
+  const int32_t lastColumn = std::min(int32_t(width), int32_t(this->width) - x) - 1;
+  const int32_t firstRow = std::max(int32_t(0), -y);
+  const int32_t lastRow = std::min(int32_t(height), int32_t(this->height) - y) - 1;
+  if (firstColumn > lastColumn) {
+    return;
+  }
+  const size_t count = size_t(lastColumn - firstColumn + 1);
+
+  for (int32_t row = firstRow; row <= lastRow; row++) {
+    const uint16_t *source = imageOrigin + firstColumn * imageStepX + row * imageStepY;
+    uint16_t *target = this->pixelAddress(x + firstColumn, y + row);
+    if (this->stepX == 1) {
+      memcpy(target, source, count * sizeof(uint16_t));
+    } else if (this->stepX == -1) {
+      memcpy(target - (count - 1), source - (count - 1), count * sizeof(uint16_t));
+    } else {
+      for (size_t i = 0; i < count; i++, source += imageStepX, target += this->stepX) {
+        *target = *source;
+      }
+    }
+  }
+}
+
+void Canvas::fillRectangle(int32_t x, int32_t y, int32_t width, int32_t height, uint16_t color) {
+  const int32_t firstRow = std::max(y, int32_t(0));
+  const int32_t lastRow = std::min(y + height, int32_t(this->height)) - 1;
+  for (int32_t row = firstRow; row <= lastRow; row++) {
+    this->fillSpan(x, x + width - 1, row, color);
+  }
+}
+
+void Canvas::drawRectangle(int32_t x, int32_t y, int32_t width, int32_t height, uint16_t lineWidth, uint16_t color) {
+  if (2 * lineWidth >= width || 2 * lineWidth >= height) {
+    this->fillRectangle(x, y, width, height, color);
+    return;
+  }
+  this->fillRectangle(x, y, width, lineWidth, color);
+  this->fillRectangle(x, y + height - lineWidth, width, lineWidth, color);
+  this->fillRectangle(x, y + lineWidth, lineWidth, height - 2 * lineWidth, color);
+  this->fillRectangle(x + width - lineWidth, y + lineWidth, lineWidth, height - 2 * lineWidth, color);
+}
+
+void Canvas::fillCircle(int32_t centerX, int32_t centerY, uint16_t radius, uint16_t color) {
+  // Midpoint circle algorithm, as in Paint_DrawCircle. Each row is filled once its span is widest.
+  int32_t x = 0;
+  auto y = int32_t(radius);
+  int32_t error = 3 - 2 * int32_t(radius);
+
+  while (x <= y) {
+    this->fillSpan(centerX - y, centerX + y, centerY + x, color);
+    this->fillSpan(centerX - y, centerX + y, centerY - x, color);
+
+    if (error < 0) {
+      error += 4 * x + 6;
+    } else {
+      this->fillSpan(centerX - x, centerX + x, centerY + y, color);
+      this->fillSpan(centerX - x, centerX + x, centerY - y, color);
+      error += 10 + 4 * (x - y);
+      y--;
+    }
+    x++;
+  }
+
+  const int32_t halfWidth = std::min(x - 1, y);
+  this->fillSpan(centerX - halfWidth, centerX + halfWidth, centerY + y, color);
+  this->fillSpan(centerX - halfWidth, centerX + halfWidth, centerY - y, color);
+}
+
+void Canvas::drawCircle(int32_t centerX, int32_t centerY, uint16_t radius, uint16_t color) {
+  // Midpoint circle algorithm, as in Paint_DrawCircle
+  int32_t x = 0;
+  auto y = int32_t(radius);
+  int32_t error = 3 - 2 * int32_t(radius);
+
+  while (x <= y) {
+    this->setPixel(centerX + x, centerY + y, color);
+    this->setPixel(centerX - x, centerY + y, color);
+    this->setPixel(centerX - y, centerY + x, color);
+    this->setPixel(centerX - y, centerY - x, color);
+    this->setPixel(centerX - x, centerY - y, color);
+    this->setPixel(centerX + x, centerY - y, color);
+    this->setPixel(centerX + y, centerY - x, color);
+    this->setPixel(centerX + y, centerY + x, color);
+
+    if (error < 0) {
+      error += 4 * x + 6;
+    } else {
+      error += 10 + 4 * (x - y);
+      y--;
+    }
+    x++;
+  }
+}
+
+void Canvas::drawString(int32_t x, int32_t y, const char *text, const sFONT *font, uint16_t color,
+                        uint16_t background) {
+  const uint16_t bytesPerRow = (font->Width + 7) / 8;
+  const bool transparent = background == FONT_BACKGROUND;
+
+  for (int32_t glyphX = x; *text != '\0'; text++, glyphX += font->Width) {
+    if (glyphX >= this->width) {
+      break;
+    }
+    if (glyphX + font->Width <= 0) {
+      continue;
+    }
+
+    const uint8_t *glyphRow = &font->table[(*text - ' ') * font->Height * bytesPerRow];
+    for (uint16_t row = 0; row < font->Height; row++, glyphRow += bytesPerRow) {
+      // Fill runs of equal bits with a single span
+      uint16_t runStart = 0;
+      while (runStart < font->Width) {
+        const bool isSet = glyphRow[runStart / 8] & (0x80 >> (runStart % 8));
+        uint16_t runEnd = runStart + 1;
+        while (runEnd < font->Width && bool(glyphRow[runEnd / 8] & (0x80 >> (runEnd % 8))) == isSet) {
+          runEnd++;
+        }
+        if (isSet || !transparent) {
+          this->fillSpan(glyphX + runStart, glyphX + runEnd - 1, y + row, isSet ? color : background);
+        }
+        runStart = runEnd;
+      }
+    }
+  }
+}
+
+void Canvas::drawString(int32_t x, int32_t y, const char *text, const GlyphAtlas &atlas) {
+  const sFONT *font = atlas.getFont();
+
+  for (int32_t glyphX = x; *text != '\0' && glyphX < this->width; text++, glyphX += font->Width) {
+    if (glyphX + font->Width <= 0) {
+      continue;
+    }
+    for (uint16_t row = 0; row < font->Height; row++) {
+      this->copySpan(glyphX, y + row, atlas.getGlyphRow(*text, row), font->Width);
+    }
+  }
+}
@@ -0,0 +1,85 @@
+#ifndef DISPLAY_CANVAS_H
+#define DISPLAY_CANVAS_H
+
+#include "fonts.h"
+#include "glyph_atlas.h"
+
+#include <cstddef>
+#include <cstdint>
+
+extern "C"
+{
+#include "GUI_Paint.h"
+}
+
+// RGB565 color in the byte order of image buffers, as stored by Paint_SetPixel
+static inline uint16_t swapBytes(uint16_t color) {
+  return uint16_t((color << 8) | (color >> 8));
+}
+
+/**
+ * Drawing primitives writing straight into an RGB565 image buffer, as a replacement of GUI_Paint.
+ * Rotation and mirroring (same meaning as in Paint_NewImage / Paint_SetMirroring) are resolved once
+ * into a pixel address step per logical axis, and primitives are clipped and filled as horizontal spans.
+ * Colors are given as plain RGB565 and stored byte-swapped, like Paint_SetPixel does.
+ * */
+class Canvas {
+public:
+  // Default orientation matches Paint_NewImage, i.e. the layout expected by drawImageBuffer
+  Canvas(uint16_t *buffer, uint16_t width, uint16_t height, uint16_t stride,
+         uint16_t rotate = ROTATE_0, uint8_t mirror = MIRROR_ORIGIN);
+
+  // Logical size, after rotation
+  uint16_t getWidth() const;
+
+  uint16_t getHeight() const;
+
+  void clear(uint16_t color);
+
+  void setPixel(int32_t x, int32_t y, uint16_t color);
+
+  // Fills pixels from x0 to x1 (inclusive) of row y
+  void fillSpan(int32_t x0, int32_t x1, int32_t y, uint16_t color);
+
+  // Copies count pixels, already byte-swapped and ordered left to right, to row y starting at x
+  void copySpan(int32_t x, int32_t y, const uint16_t *pixels, int32_t count);
+
+  /**
+   * Copies an image stored in the same orientation as this canvas (e.g. in the panel layout of drawImageBuffer
+   * for the default one) and already byte-swapped, so image rows are copied with memcpy.
+   * */
+  void copyImage(int32_t x, int32_t y, const uint16_t *image, uint16_t width, uint16_t height);
+
+  void fillRectangle(int32_t x, int32_t y, int32_t width, int32_t height, uint16_t color);
+
+  // Rectangle outline drawn inside of given bounds
+  void drawRectangle(int32_t x, int32_t y, int32_t width, int32_t height, uint16_t lineWidth, uint16_t color);
+
+  void fillCircle(int32_t centerX, int32_t centerY, uint16_t radius, uint16_t color);
+
+  // One pixel wide circle outline
+  void drawCircle(int32_t centerX, int32_t centerY, uint16_t radius, uint16_t color);
+
+  /**
+   * Draws single line of text in fixed width font. Glyph rows are filled as runs of foreground
+   * and background pixels. Background equal to FONT_BACKGROUND is left transparent, as in GUI_Paint.
+   * */
+  void drawString(int32_t x, int32_t y, const char *text, const sFONT *font, uint16_t color, uint16_t background);
+
+  // Draws single line of text by copying pre-expanded glyph rows, with atlas colors
+  void drawString(int32_t x, int32_t y, const char *text, const GlyphAtlas &atlas);
+
+private:
+  inline uint16_t *pixelAddress(int32_t x, int32_t y) const {
+    return this->origin + x * this->stepX + y * this->stepY;
+  }
+
+  uint16_t width;
+  uint16_t height;
+  // Address of logical (0, 0) and address differences between logically adjacent pixels
+  uint16_t *origin;
+  ptrdiff_t stepX;
+  ptrdiff_t stepY;
+};
+
+#endif // DISPLAY_CANVAS_H
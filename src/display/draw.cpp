@@ -1,5 +1,6 @@
 #include "draw.h"
 
+#include "canvas.h"
 #include "utils.h"
 #include "Debug.h"
 #include <stdio.h>
@@ -165,9 +166,9 @@ void drawTextLine(const char *text, uint16_t x, uint16_t y, uint16_t width, uint
     break;
   }
 
-  Paint_NewImage(textImage, width, font->Height, 0, WHITE, 16);
-  Paint_Clear(background);
-  Paint_DrawString_EN(aligned_x, 0, text, font, background, color);
+  Canvas canvas(textImage, width, font->Height, width);
+  canvas.clear(background);
+  canvas.drawString(aligned_x, 0, text, font, color, background);
   drawImageBuffer(textImage, x, y, width, font->Height);
 
   free(textImage);
@@ -0,0 +1,46 @@
+#include "glyph_atlas.h"
+#include "canvas.h"
+
+#define GLYPH_ATLAS_CHAR_COUNT (GLYPH_ATLAS_LAST_CHAR - GLYPH_ATLAS_FIRST_CHAR + 1)
+
+GlyphAtlas::GlyphAtlas() : font(nullptr), color(0), background(0) {
+}
+
+GlyphAtlas::GlyphAtlas(const sFONT *font, uint16_t color, uint16_t background) : GlyphAtlas() {
+  this->prepare(font, color, background);
+}
+
+void GlyphAtlas::prepare(const sFONT *font, uint16_t color, uint16_t background) {
+  if (this->font == font && this->color == color && this->background == background) {
+    return;
+  }
+  this->font = font;
+  this->color = color;
+  this->background = background;
+
+  const uint16_t bytesPerRow = (font->Width + 7) / 8;
+  const uint16_t swappedColor = swapBytes(color);
+  const uint16_t swappedBackground = swapBytes(background);
+
+  this->pixels.resize(size_t(GLYPH_ATLAS_CHAR_COUNT) * font->Height * font->Width);
+  uint16_t *pixel = this->pixels.data();
+  const uint8_t *bits = font->table;
+  for (uint32_t rowIndex = 0; rowIndex < uint32_t(GLYPH_ATLAS_CHAR_COUNT) * font->Height; rowIndex++) {
+    for (uint16_t column = 0; column < font->Width; column++) {
+      *pixel++ = (bits[column / 8] & (0x80 >> (column % 8))) ? swappedColor : swappedBackground;
+    }
+    bits += bytesPerRow;
+  }
+}
+
+const sFONT *GlyphAtlas::getFont() const {
+  return this->font;
+}
+
+const uint16_t *GlyphAtlas::getGlyphRow(char character, uint16_t row) const {
+  if (character < GLYPH_ATLAS_FIRST_CHAR || character > GLYPH_ATLAS_LAST_CHAR) {
+    character = ' ';
+  }
+  const size_t glyphIndex = size_t(character - GLYPH_ATLAS_FIRST_CHAR);
+  return &this->pixels[(glyphIndex * this->font->Height + row) * this->font->Width];
+}
@@ -0,0 +1,40 @@
+#ifndef DISPLAY_GLYPH_ATLAS_H
+#define DISPLAY_GLYPH_ATLAS_H
+
+#include "fonts.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Printable ASCII range covered by the bitmap fonts in lib/Fonts
+#define GLYPH_ATLAS_FIRST_CHAR ' '
+#define GLYPH_ATLAS_LAST_CHAR '~'
+
+/**
+ * Bitmap font expanded into ready-to-copy RGB565 pixels (byte-swapped, as stored in image buffers)
+ * for one foreground and background color pair, so text is drawn by copying whole glyph rows.
+ * Characters outside of the printable range are drawn as space.
+ * */
+class GlyphAtlas {
+public:
+  GlyphAtlas();
+
+  GlyphAtlas(const sFONT *font, uint16_t color, uint16_t background);
+
+  // Expands the font for given colors, does nothing if the atlas already holds them
+  void prepare(const sFONT *font, uint16_t color, uint16_t background);
+
+  const sFONT *getFont() const;
+
+  // Font->Width pixels of given glyph row
+  const uint16_t *getGlyphRow(char character, uint16_t row) const;
+
+private:
+  const sFONT *font;
+  uint16_t color;
+  uint16_t background;
+  std::vector<uint16_t> pixels;
+};
+
+#endif // DISPLAY_GLYPH_ATLAS_H
@@ -1,5 +1,6 @@
 #include "loader.h"
 
+#include "canvas.h"
 #include "draw.h"
 
 #include <cstdio>
@@ -18,7 +19,11 @@ void showThreeDotsLoader(uint16_t x, uint16_t y, bool (*condition)())
 {
   uint16_t *loaderImage = allocateImageBuffer(THREE_DOTS_LOADER_WIDTH, THREE_DOTS_LOADER_HEIGHT);
 
-  Paint_NewImage(loaderImage, THREE_DOTS_LOADER_WIDTH, THREE_DOTS_LOADER_HEIGHT, 0, WHITE, 24);
+  if (loaderImage == nullptr)
+  {
+    return;
+  }
+  Canvas canvas(loaderImage, THREE_DOTS_LOADER_WIDTH, THREE_DOTS_LOADER_HEIGHT, THREE_DOTS_LOADER_WIDTH);
 
   const uint16_t left = THREE_DOTS_LOADER_HEIGHT / 2;
   const uint16_t right = THREE_DOTS_LOADER_WIDTH - THREE_DOTS_LOADER_HEIGHT / 2;
@@ -28,7 +33,7 @@ void showThreeDotsLoader(uint16_t x, uint16_t y, bool (*condition)())
 
   while (condition())
   {
-    Paint_Clear(BLACK);
+    canvas.clear(BLACK);
 
     for (uint8_t i = 0; i < DOTS_COUNT; i++)
     {
@@ -44,7 +49,7 @@ void showThreeDotsLoader(uint16_t x, uint16_t y, bool (*condition)())
       }
       if (x + r < THREE_DOTS_LOADER_WIDTH)
       {
-        Paint_DrawCircle(x, THREE_DOTS_LOADER_HEIGHT / 2, r, CYAN, DOT_PIXEL_8X8, DRAW_FILL_FULL);
+        canvas.fillCircle(x, THREE_DOTS_LOADER_HEIGHT / 2, r, CYAN);
       }
     }
 
@@ -0,0 +1,220 @@
+#include "polyline.h"
+#include "canvas.h"
+
+#include "utils.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#define FIXED_POINT_BITS 16
+// Consecutive segments are merged while the shared point stays this close to the merged segment (sub-pixel units)
+#define MERGE_TOLERANCE (POLYLINE_SUBPIXEL_SCALE / 8)
+// Longest merged segment, which keeps the accumulated deviation of merged points small (sub-pixel units)
+#define MERGE_MAX_LENGTH (16 * POLYLINE_SUBPIXEL_SCALE)
+
+static inline int32_t floorToPixel(int64_t value) {
+  return int32_t(value >> POLYLINE_SUBPIXEL_BITS); // Arithmetic shift rounds towards negative infinity
+}
+
+PolylineRasterizer::PolylineRasterizer(uint16_t width, uint16_t height) :
+    width(width), height(height),
+    coverage(size_t(width) * size_t(height), 0),
+    dirtyRowMinX(height, int16_t(width)), dirtyRowMaxX(height, -1), dirtyMinY(height), dirtyMaxY(-1),
+    pendingStartX(0), pendingStartY(0), pendingEndX(0), pendingEndY(0), hasPendingSegment(false),
+    lineWidth(0), outerRadius(0), innerRadiusSquared(0), outerRadiusSquared(0), coverageScale(0) {
+  memset(this->coverageTable, 0, sizeof(this->coverageTable));
+}
+
+void PolylineRasterizer::begin(uint32_t lineWidth) {
+  this->hasPendingSegment = false;
+  if (lineWidth == this->lineWidth) {
+    return;
+  }
+  this->lineWidth = lineWidth;
+
+  const int64_t radius = int64_t(lineWidth) / 2;
+  const int64_t innerRadius = std::max(radius - POLYLINE_SUBPIXEL_SCALE / 2, int64_t(0));
+
+  // Pixel coverage falls off linearly within one pixel wide band centered on the line edge
+  this->outerRadius = radius + POLYLINE_SUBPIXEL_SCALE / 2;
+  this->innerRadiusSquared = innerRadius * innerRadius;
+  this->outerRadiusSquared = this->outerRadius * this->outerRadius;
+  this->coverageScale = (int64_t(255) << FIXED_POINT_BITS) / (this->outerRadiusSquared - this->innerRadiusSquared);
+
+  for (int64_t i = 0; i < 256; i++) {
+    int64_t distanceSquared =
+        this->innerRadiusSquared + (this->outerRadiusSquared - this->innerRadiusSquared) * i / 255;
+    int64_t distance = integerSquareRoot(uint64_t(distanceSquared));
+    int64_t value = (this->outerRadius - distance) * 255 / POLYLINE_SUBPIXEL_SCALE;
+    this->coverageTable[i] = uint8_t(std::max(int64_t(0), std::min(int64_t(255), value)));
+  }
+}
+
+void PolylineRasterizer::addSegment(int32_t startX, int32_t startY, int32_t endX, int32_t endY) {
+  if (this->hasPendingSegment && startX == this->pendingEndX && startY == this->pendingEndY) {
+    const int64_t pendingDeltaX = int64_t(this->pendingEndX) - this->pendingStartX;
+    const int64_t pendingDeltaY = int64_t(this->pendingEndY) - this->pendingStartY;
+    const int64_t mergedDeltaX = int64_t(endX) - this->pendingStartX;
+    const int64_t mergedDeltaY = int64_t(endY) - this->pendingStartY;
+
+    if (std::abs(mergedDeltaX) <= MERGE_MAX_LENGTH && std::abs(mergedDeltaY) <= MERGE_MAX_LENGTH) {
+      // Distance of the shared point from the merged segment is cross / |merged|, compared without division
+      const int64_t cross = pendingDeltaX * mergedDeltaY - pendingDeltaY * mergedDeltaX;
+      const int64_t mergedLengthSquared = mergedDeltaX * mergedDeltaX + mergedDeltaY * mergedDeltaY;
+      if (cross * cross <= int64_t(MERGE_TOLERANCE * MERGE_TOLERANCE) * mergedLengthSquared) {
+        this->pendingEndX = endX;
+        this->pendingEndY = endY;
+        return;
+      }
+    }
+  }
+
+  if (this->hasPendingSegment) {
+    this->rasterizeSegment(this->pendingStartX, this->pendingStartY, this->pendingEndX, this->pendingEndY);
+  }
+  this->pendingStartX = startX;
+  this->pendingStartY = startY;
+  this->pendingEndX = endX;
+  this->pendingEndY = endY;
+  this->hasPendingSegment = true;
+}
+
+void PolylineRasterizer::rasterizeSegment(int32_t startX, int32_t startY, int32_t endX, int32_t endY) {
+  const int64_t deltaX = int64_t(endX) - startX;
+  const int64_t deltaY = int64_t(endY) - startY;
+  const auto length = int64_t(integerSquareRoot(uint64_t(deltaX * deltaX + deltaY * deltaY)));
+
+  const int32_t minRow = std::max(floorToPixel(std::min(startY, endY) - this->outerRadius), int32_t(0));
+  const int32_t maxRow = std::min(floorToPixel(std::max(startY, endY) + this->outerRadius),
+                                  int32_t(this->height) - 1);
+  const int32_t minColumn = std::max(floorToPixel(std::min(startX, endX) - this->outerRadius), int32_t(0));
+  const int32_t maxColumn = std::min(floorToPixel(std::max(startX, endX) + this->outerRadius),
+                                     int32_t(this->width) - 1);
+  if (minRow > maxRow || minColumn > maxColumn) {
+    return;
+  }
+
+  // Unit direction vector (fixed point)
+  // A zero-length segment keeps an arbitrary direction and is drawn as a dot by the round caps
+  int64_t directionX = int64_t(1) << FIXED_POINT_BITS;
+  int64_t directionY = 0;
+  if (length > 0) {
+    const int64_t inverseLength = (int64_t(1) << (2 * FIXED_POINT_BITS)) / length;
+    directionX = (deltaX * inverseLength) >> FIXED_POINT_BITS;
+    directionY = (deltaY * inverseLength) >> FIXED_POINT_BITS;
+  }
+  // Horizontal step of the centerline per vertical sub-pixel and half width of the band it covers in a row
+  int64_t inverseSlope = 0;
+  int64_t bandHalfWidth = 0;
+  if (deltaY != 0) {
+    inverseSlope = deltaX * (int64_t(1) << FIXED_POINT_BITS) / deltaY;
+    bandHalfWidth = this->outerRadius * length / std::abs(deltaY) + 1;
+  }
+  const int64_t columnStepAlong = int64_t(POLYLINE_SUBPIXEL_SCALE) * directionX;
+  const int64_t columnStepAcross = int64_t(POLYLINE_SUBPIXEL_SCALE) * directionY;
+
+  // Pixels examined lie within a few pixels of the segment, so per-pixel arithmetic fits into 32 bits
+  const auto segmentLength = int32_t(length);
+  const auto innerRadiusSquared = int32_t(this->innerRadiusSquared);
+  const auto outerRadiusSquared = int32_t(this->outerRadiusSquared);
+  const auto coverageScale = int32_t(this->coverageScale);
+
+  for (int32_t row = minRow; row <= maxRow; row++) {
+    const int64_t centerY = (int64_t(row) << POLYLINE_SUBPIXEL_BITS) + POLYLINE_SUBPIXEL_SCALE / 2;
+
+    // Horizontal extent of the band around the (extended) centerline in this row, the bounding box cuts off the caps
+    int32_t firstColumn = minColumn;
+    int32_t lastColumn = maxColumn;
+    if (deltaY != 0) {
+      const int64_t centerX = startX + (((centerY - startY) * inverseSlope) >> FIXED_POINT_BITS);
+      firstColumn = std::max(floorToPixel(centerX - bandHalfWidth), minColumn);
+      lastColumn = std::min(floorToPixel(centerX + bandHalfWidth), maxColumn);
+    }
+    if (firstColumn > lastColumn) {
+      continue;
+    }
+
+    const int64_t offsetY = centerY - startY;
+    const int64_t offsetX =
+        (int64_t(firstColumn) << POLYLINE_SUBPIXEL_BITS) + POLYLINE_SUBPIXEL_SCALE / 2 - startX;
+    // Position of the pixel center along and across the segment, advanced incrementally per column
+    int64_t along = offsetX * directionX + offsetY * directionY;
+    int64_t across = offsetY * directionX - offsetX * directionY;
+
+    uint8_t *coverageRow = &this->coverage[size_t(row) * this->width];
+    this->dirtyRowMinX[row] = int16_t(std::min(int32_t(this->dirtyRowMinX[row]), firstColumn));
+    this->dirtyRowMaxX[row] = int16_t(std::max(int32_t(this->dirtyRowMaxX[row]), lastColumn));
+
+    // Branch-free inner loop: squared distance is clamped to the table range, the table maps it to coverage
+    // (255 up to the inner radius, 0 from the outer radius on)
+    for (int32_t column = firstColumn; column <= lastColumn; column++) {
+      const auto alongPixels = int32_t(along >> FIXED_POINT_BITS);
+      const auto acrossPixels = int32_t(across >> FIXED_POINT_BITS);
+      along += columnStepAlong;
+      across -= columnStepAcross;
+
+      // Beyond the segment ends distance is measured to the end point (round caps and joins)
+      const int32_t beyond = alongPixels - std::max(int32_t(0), std::min(alongPixels, segmentLength));
+      const int32_t distanceSquared = std::min(beyond * beyond + acrossPixels * acrossPixels, outerRadiusSquared);
+
+      const int32_t tableIndex = ((distanceSquared - innerRadiusSquared) * coverageScale) >> FIXED_POINT_BITS;
+      const uint8_t value = this->coverageTable[std::max(int32_t(0), std::min(tableIndex, int32_t(255)))];
+      coverageRow[column] = std::max(coverageRow[column], value);
+    }
+  }
+
+  this->dirtyMinY = std::min(this->dirtyMinY, minRow);
+  this->dirtyMaxY = std::max(this->dirtyMaxY, maxRow);
+}
+
+void PolylineRasterizer::finish(uint16_t *buffer, uint16_t color) {
+  if (this->hasPendingSegment) {
+    this->rasterizeSegment(this->pendingStartX, this->pendingStartY, this->pendingEndX, this->pendingEndY);
+    this->hasPendingSegment = false;
+  }
+
+  const int32_t foregroundRed = (color >> 11) & 0x1F;
+  const int32_t foregroundGreen = (color >> 5) & 0x3F;
+  const int32_t foregroundBlue = color & 0x1F;
+
+  for (int32_t row = this->dirtyMinY; row <= this->dirtyMaxY; row++) {
+    const int32_t firstColumn = this->dirtyRowMinX[row];
+    const int32_t lastColumn = this->dirtyRowMaxX[row];
+    this->dirtyRowMinX[row] = int16_t(this->width);
+    this->dirtyRowMaxX[row] = -1;
+
+    uint8_t *coverageRow = &this->coverage[size_t(row) * this->width];
+    // Buffer is rotated by 180 degrees so pixels of a row are visited backwards
+    uint16_t *bufferRow = buffer + size_t(this->height - 1 - row) * this->width + (this->width - 1);
+
+    for (int32_t column = firstColumn; column <= lastColumn; column++) {
+      const int32_t alpha = coverageRow[column];
+      if (alpha == 0) {
+        continue;
+      }
+      coverageRow[column] = 0;
+
+      uint16_t *pixel = bufferRow - column;
+      if (alpha == 255) {
+        *pixel = swapBytes(color);
+        continue;
+      }
+
+      const uint16_t background = swapBytes(*pixel);
+      const int32_t red = (background >> 11) & 0x1F;
+      const int32_t green = (background >> 5) & 0x3F;
+      const int32_t blue = background & 0x1F;
+      const int32_t weight = alpha + (alpha >> 7); // 0-256
+
+      *pixel = swapBytes(uint16_t(
+          ((red + (((foregroundRed - red) * weight) >> 8)) << 11) |
+          ((green + (((foregroundGreen - green) * weight) >> 8)) << 5) |
+          (blue + (((foregroundBlue - blue) * weight) >> 8))
+      ));
+    }
+  }
+
+  this->dirtyMinY = this->height;
+  this->dirtyMaxY = -1;
+}
@@ -0,0 +1,65 @@
+#ifndef DISPLAY_POLYLINE_H
+#define DISPLAY_POLYLINE_H
+
+#include <cstdint>
+#include <vector>
+
+// Number of fractional bits of sub-pixel coordinates accepted by PolylineRasterizer
+#define POLYLINE_SUBPIXEL_BITS 8
+#define POLYLINE_SUBPIXEL_SCALE (1 << POLYLINE_SUBPIXEL_BITS)
+
+/**
+ * Integer-only rasterizer of thick, anti-aliased polylines.
+ * Segments are rendered as capsules into an 8-bit coverage mask (keeping maximal coverage per pixel, which gives
+ * round joins and caps without double blending), then composited in a single pass into the target RGB565 buffer.
+ * Target buffer uses the same layout as images drawn with drawImageBuffer:
+ * rotated by 180 degrees and with byte-swapped pixels.
+ * */
+class PolylineRasterizer {
+public:
+  PolylineRasterizer(uint16_t width, uint16_t height);
+
+  // Starts a new polyline. Line width is given in sub-pixel units.
+  void begin(uint32_t lineWidth);
+
+  /**
+   * Coordinates are given in sub-pixel units (see POLYLINE_SUBPIXEL_BITS) relative to the top-left corner.
+   * Nearly collinear segments continuing the previous one are merged before rasterization,
+   * so dense polylines cost about as much as their simplified shape.
+   * */
+  void addSegment(int32_t startX, int32_t startY, int32_t endX, int32_t endY);
+
+  // Blends covered pixels with given color into the buffer and clears the coverage mask
+  void finish(uint16_t *buffer, uint16_t color);
+
+private:
+  void rasterizeSegment(int32_t startX, int32_t startY, int32_t endX, int32_t endY);
+
+  const uint16_t width;
+  const uint16_t height;
+
+  std::vector<uint8_t> coverage;
+  // Columns touched since begin() per row (inclusive), empty when min > max, so finish() skips untouched pixels
+  std::vector<int16_t> dirtyRowMinX;
+  std::vector<int16_t> dirtyRowMaxX;
+  // Rows touched since begin() (inclusive), empty when dirtyMinY > dirtyMaxY
+  int32_t dirtyMinY;
+  int32_t dirtyMaxY;
+
+  // Segment collected by addSegment and not rasterized yet
+  int32_t pendingStartX;
+  int32_t pendingStartY;
+  int32_t pendingEndX;
+  int32_t pendingEndY;
+  bool hasPendingSegment;
+
+  uint32_t lineWidth; // Sub-pixel units, coverage table below is rebuilt only when it changes
+  int64_t outerRadius; // Sub-pixel units
+  int64_t innerRadiusSquared;
+  int64_t outerRadiusSquared;
+  int64_t coverageScale;
+  // Coverage (0-255) for squared distances between inner and outer radius, avoiding square root per pixel
+  uint8_t coverageTable[256];
+};
+
+#endif // DISPLAY_POLYLINE_H
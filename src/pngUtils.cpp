@@ -1,16 +1,129 @@
 #include "pngUtils.h"
 
+#include <cstdlib>
 #include <iostream>
 
-std::pair<uint16_t, uint16_t> parsePngData(std::vector<uint8_t> &outData, uint8_t *pngData, uint32_t pngDataLength) {
+#ifdef USE_SYSTEM_ZLIB
+#include <zlib.h>
+
+#define INFLATE_INITIAL_RATIO 4 // Initial output buffer size relative to compressed data, doubled as needed
+
+/**
+ * lodepng custom_zlib backed by system zlib, whose inflate is several times faster than the built-in one.
+ * Output is allocated with malloc, as lodepng frees it.
+ * */
+static unsigned inflateWithSystemZlib(unsigned char **out, size_t *outSize, const unsigned char *in, size_t inSize,
+                                      const LodePNGDecompressSettings *settings) {
+  z_stream stream = {};
+  if (inflateInit(&stream) != Z_OK) {
+    return 1;
+  }
+
+  size_t capacity = inSize * INFLATE_INITIAL_RATIO + 1024;
+  auto *buffer = (unsigned char *) malloc(capacity);
+  size_t size = 0;
+  stream.next_in = const_cast<unsigned char *>(in);
+  stream.avail_in = uInt(inSize);
+
+  int result = buffer != nullptr ? Z_OK : Z_MEM_ERROR;
+  while (result == Z_OK) {
+    if (size == capacity) {
+      if (settings->max_output_size != 0 && capacity >= settings->max_output_size) {
+        result = Z_BUF_ERROR;
+        break;
+      }
+      auto *grown = (unsigned char *) realloc(buffer, capacity * 2);
+      if (grown == nullptr) {
+        result = Z_MEM_ERROR;
+        break;
+      }
+      buffer = grown;
+      capacity *= 2;
+    }
+    stream.next_out = buffer + size;
+    stream.avail_out = uInt(capacity - size);
+    result = inflate(&stream, Z_NO_FLUSH);
+    size = capacity - stream.avail_out;
+    if (result == Z_OK && size < capacity) {
+      result = Z_BUF_ERROR; // Input ended before the end of the stream
+    }
+  }
+  inflateEnd(&stream);
+
+  if (result != Z_STREAM_END) {
+    free(buffer);
+    *outSize = size;
+    return 1;
+  }
+  *out = buffer;
+  *outSize = size;
+  return 0;
+}
+#endif // USE_SYSTEM_ZLIB
+
+static void initializeTileDecoderState(lodepng::State &state) {
+#ifdef USE_SYSTEM_ZLIB
+  state.decoder.zlibsettings.custom_zlib = inflateWithSystemZlib;
+#else
+  (void) state;
+#endif
+}
+
+std::pair<uint16_t, uint16_t> parsePngData(std::vector<uint8_t> &outData, const uint8_t *pngData, uint32_t pngDataLength) {
   unsigned width, height;
   outData.clear();
-  unsigned error = lodepng::decode(outData, width, height, pngData, pngDataLength, LCT_RGB);
+  lodepng::State state;
+  initializeTileDecoderState(state);
+  state.info_raw.colortype = LCT_RGB;
+  unsigned error = lodepng::decode(outData, width, height, state, pngData, pngDataLength);
+  if (error) {
+    std::cout << "decoder error " << error << ": " << lodepng_error_text(error) << std::endl;
+    return std::make_pair(0, 0);
+  }
+
+  return std::make_pair(width, height);
+}
+
+std::pair<uint16_t, uint16_t> parsePalettePngData(std::vector<uint8_t> &outIndices, Rgb565Palette &outPalette,
+                                                  const uint8_t *pngData, uint32_t pngDataLength) {
+  unsigned width, height;
+  outIndices.clear();
+  lodepng::State state;
+  initializeTileDecoderState(state);
+  if (lodepng_inspect(&width, &height, &state, pngData, pngDataLength) != 0 ||
+      state.info_png.color.colortype != LCT_PALETTE) {
+    return std::make_pair(0, 0);
+  }
+
+  // Image data is kept as stored, packed indices of the PNG bit depth without padding between rows
+  state.decoder.color_convert = 0;
+  std::vector<uint8_t> packedIndices;
+  unsigned error = lodepng::decode(packedIndices, width, height, state, pngData, pngDataLength);
   if (error) {
     std::cout << "decoder error " << error << ": " << lodepng_error_text(error) << std::endl;
     return std::make_pair(0, 0);
   }
 
+  const LodePNGColorMode &color = state.info_png.color;
+  outPalette.fill(0);
+  for (size_t i = 0; i < color.palettesize && i < outPalette.size(); i++) {
+    const unsigned char *entry = &color.palette[i * 4]; // RGBA, alpha is dropped as when decoding to RGB
+    outPalette[i] = uint16_t(((entry[0] >> 3) << 11) | ((entry[1] >> 2) << 5) | (entry[2] >> 3));
+  }
+
+  const size_t pixelsCount = size_t(width) * height;
+  const unsigned bitDepth = color.bitdepth;
+  if (bitDepth == 8) {
+    outIndices.swap(packedIndices);
+  } else {
+    outIndices.resize(pixelsCount);
+    const unsigned mask = (1u << bitDepth) - 1;
+    for (size_t i = 0; i < pixelsCount; i++) {
+      const size_t bit = i * bitDepth;
+      outIndices[i] = uint8_t((packedIndices[bit >> 3] >> (8 - bitDepth - (bit & 7))) & mask);
+    }
+  }
+
   return std::make_pair(width, height);
 }
 
@@ -1,12 +1,22 @@
 #ifndef BIKETOURASSISTANT_PNGUTILS_H
 #define BIKETOURASSISTANT_PNGUTILS_H
 
+#include <array>
 #include <cstdint>
 #include <iostream>
 #include <vector>
 #include "lodepng/lodepng.h"
 
-std::pair<uint16_t, uint16_t> parsePngData(std::vector<uint8_t> &outData, uint8_t *pngData, uint32_t pngDataLength);
+typedef std::array<uint16_t, 256> Rgb565Palette;
+
+std::pair<uint16_t, uint16_t> parsePngData(std::vector<uint8_t> &outData, const uint8_t *pngData, uint32_t pngDataLength);
+
+/**
+ * Decodes a palette PNG into one palette index per pixel, row by row, and its palette converted to RGB565
+ * (entries past the PNG palette are black). Returns 0, 0 if the PNG is not palette based or cannot be decoded.
+ * */
+std::pair<uint16_t, uint16_t> parsePalettePngData(std::vector<uint8_t> &outIndices, Rgb565Palette &outPalette,
+                                                  const uint8_t *pngData, uint32_t pngDataLength);
 
 std::pair<uint16_t, uint16_t> loadPngFile(std::vector<uint8_t> &outData, const std::string &filename,
                                           LodePNGColorType colorType = LCT_RGB);
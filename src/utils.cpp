@@ -69,6 +69,7 @@ char *executeCommand(const char *command) {
   int exit_status = pclose(pipe);
   if (WEXITSTATUS(exit_status) != 0) {
     fprintf(stderr, "Command exited with status: %d\n", WEXITSTATUS(exit_status));
+    free(cmd_output);
     return nullptr;
   }
 
@@ -172,116 +173,26 @@ uint16_t findNextPowerOf2(uint16_t n) {
   return 1 << count;
 }
 
-float bytesToFloat(const uint8_t *bytes, bool big_endian) {
-  float f;
-  auto *f_ptr = (uint8_t *) &f;
-  if (big_endian) {
-    f_ptr[3] = bytes[0];
-    f_ptr[2] = bytes[1];
-    f_ptr[1] = bytes[2];
-    f_ptr[0] = bytes[3];
-  } else {
-    f_ptr[3] = bytes[3];
-    f_ptr[2] = bytes[2];
-    f_ptr[1] = bytes[1];
-    f_ptr[0] = bytes[0];
+uint32_t integerSquareRoot(uint64_t value) {
+  if (value == 0) {
+    return 0;
   }
-  return f;
-}
 
-double bytesToDouble(const uint8_t *bytes, bool big_endian) {
-  double d;
-  auto *d_ptr = (uint8_t *) &d;
-  if (big_endian) {
-    d_ptr[7] = bytes[0];
-    d_ptr[6] = bytes[1];
-    d_ptr[5] = bytes[2];
-    d_ptr[4] = bytes[3];
-    d_ptr[3] = bytes[4];
-    d_ptr[2] = bytes[5];
-    d_ptr[1] = bytes[6];
-    d_ptr[0] = bytes[7];
-  } else {
-    d_ptr[7] = bytes[7];
-    d_ptr[6] = bytes[6];
-    d_ptr[5] = bytes[5];
-    d_ptr[4] = bytes[4];
-    d_ptr[3] = bytes[3];
-    d_ptr[2] = bytes[2];
-    d_ptr[1] = bytes[1];
-    d_ptr[0] = bytes[0];
-  }
-  return d;
-}
+  uint64_t result = 0;
+  // Highest power of four not greater than value
+  uint64_t bit = uint64_t(1) << ((63 - __builtin_clzll(value)) & ~1);
 
-uint16_t bytesToUint16(const uint8_t *bytes, bool big_endian) {
-  uint16_t i;
-  auto *i_ptr = (uint8_t *) &i;
-  if (big_endian) {
-    i_ptr[1] = bytes[0];
-    i_ptr[0] = bytes[1];
-  } else {
-    i_ptr[1] = bytes[1];
-    i_ptr[0] = bytes[0];
-  }
-  return i;
-}
-
-uint32_t bytesToUint32(const uint8_t *bytes, bool big_endian) {
-  uint32_t i;
-  auto *i_ptr = (uint8_t *) &i;
-  if (big_endian) {
-    i_ptr[3] = bytes[0];
-    i_ptr[2] = bytes[1];
-    i_ptr[1] = bytes[2];
-    i_ptr[0] = bytes[3];
-  } else {
-    i_ptr[3] = bytes[3];
-    i_ptr[2] = bytes[2];
-    i_ptr[1] = bytes[1];
-    i_ptr[0] = bytes[0];
-  }
-  return i;
-}
-
-uint64_t bytesToUint64(const uint8_t *bytes, bool big_endian) {
-  uint64_t i;
-  auto *i_ptr = (uint8_t *) &i;
-  if (big_endian) {
-    i_ptr[7] = bytes[0];
-    i_ptr[6] = bytes[1];
-    i_ptr[5] = bytes[2];
-    i_ptr[4] = bytes[3];
-    i_ptr[3] = bytes[4];
-    i_ptr[2] = bytes[5];
-    i_ptr[1] = bytes[6];
-    i_ptr[0] = bytes[7];
-  } else {
-    i_ptr[7] = bytes[7];
-    i_ptr[6] = bytes[6];
-    i_ptr[5] = bytes[5];
-    i_ptr[4] = bytes[4];
-    i_ptr[3] = bytes[3];
-    i_ptr[2] = bytes[2];
-    i_ptr[1] = bytes[1];
-    i_ptr[0] = bytes[0];
+  while (bit != 0) {
+    if (value >= result + bit) {
+      value -= result + bit;
+      result = (result >> 1) + bit;
+    } else {
+      result >>= 1;
+    }
+    bit >>= 2;
   }
-  return i;
-}
 
-void uint32ToBytes(uint32_t value, uint8_t *bytes, bool big_endian) {
-  auto *value_ptr = (uint8_t *) &value;
-  if (big_endian) {
-    bytes[0] = value_ptr[3];
-    bytes[1] = value_ptr[2];
-    bytes[2] = value_ptr[1];
-    bytes[3] = value_ptr[0];
-  } else {
-    bytes[0] = value_ptr[0];
-    bytes[1] = value_ptr[1];
-    bytes[2] = value_ptr[2];
-    bytes[3] = value_ptr[3];
-  }
+  return uint32_t(result);
 }
 
 double metersPerSecondToKmPerHour(double metersPerSecond) {
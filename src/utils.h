@@ -30,17 +30,7 @@ uint16_t convertRgbColor(uint16_t color);
 
 uint16_t findNextPowerOf2(uint16_t n);
 
-float bytesToFloat(const uint8_t *bytes, bool big_endian);
-
-double bytesToDouble(const uint8_t *bytes, bool big_endian);
-
-uint16_t bytesToUint16(const uint8_t *bytes, bool big_endian);
-
-uint32_t bytesToUint32(const uint8_t *bytes, bool big_endian);
-
-uint64_t bytesToUint64(const uint8_t *bytes, bool big_endian);
-
-void uint32ToBytes(uint32_t value, uint8_t *bytes, bool big_endian);
+uint32_t integerSquareRoot(uint64_t value); // floor(sqrt(value))
 
 double metersPerSecondToKmPerHour(double metersPerSecond);
 